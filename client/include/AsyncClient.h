@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <boost/asio.hpp>
+#include "ConnectionHandler.h"
+#include "StompProtocol.h"
+#include "SessionState.h"
+#include "ClientOptions.h"
+
+// Runs a logged in session on a single thread: the socket reads and writes and the console reads
+// all run asynchronously on the ConnectionHandler's io_service, so the protocol state is only ever
+// touched by that one thread. Selected with "StompWCIClient --async".
+class AsyncClient
+{
+    private:
+        ConnectionHandler& handler;
+        StompProtocol& protocol;
+        SessionState& session;
+        ClientOptions& options;
+        // A duplicate of stdin, read with async_read_until
+        boost::asio::posix::stream_descriptor console;
+        boost::asio::streambuf consoleBuffer;
+
+        void readConsole();
+        void handleLine(const std::string& line);
+        void handleFrame(const char* frame, size_t length);
+        // Ends the session: stops reading the console and closes the connection, so run() returns
+        void finish();
+
+    public:
+        AsyncClient(ConnectionHandler& handler, StompProtocol& protocol, SessionState& session, ClientOptions& options);
+        AsyncClient(const AsyncClient&) = delete;
+        AsyncClient& operator=(const AsyncClient&) = delete;
+
+        // Takes over the console. Returns false if stdin can't be read asynchronously (e.g. it is a regular file).
+        bool openConsole();
+
+        // Runs the session until logout, a server error or a disconnect.
+        // pendingInput is console input that was already read (and not handled) before the session started.
+        void run(const std::string& pendingInput);
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <iostream>
+#include <cstddef>
+#include <atomic>
+#include "IoModes.h"
+
+// Client side tuning knobs, changed from the console with "set <option> <value>"
+struct ClientOptions
+{
+    // Most frames coalesced into one write when publishing (1 = write every frame on its own)
+    size_t batchFrames;
+    // Most bytes coalesced into one write when publishing
+    size_t batchBytes;
+    // How report reads the events file ("stream" or "mmap")
+    EventFileInput eventsInput;
+    // Send queue watermarks in bytes: once queueHigh bytes wait to be written the queue is full
+    // until it drains to queueLow
+    size_t queueHigh;
+    size_t queueLow;
+    // What report does while the send queue is full ("block", "drop" or "would-block")
+    OverflowMode reportOverflow;
+    // Threads that build the frames of report (1 = build each frame right after its event is parsed)
+    size_t reportThreads;
+    // Whether summary writes a temporary file and renames it over the target ("atomic") or writes the target itself ("direct")
+    bool atomicSummary;
+    // Reports received are stored but not printed ("set quiet on"). Read by the socket thread, hence atomic.
+    std::atomic<bool> quiet;
+    // Where "set stats-dump <seconds>" appends a line of ClientStats totals every so many seconds
+    std::string statsFile;
+    // 0 = no dump
+    unsigned int statsDumpSeconds;
+
+    ClientOptions();
+
+    // Applies a single option. Returns false and fills error for unknown options or bad values.
+    bool set(const std::string &option, const std::string &value, std::string &error);
+    // Handles the arguments of the "set <option> <value>" console command, printing errors to out
+    void setFromConsole(std::istream &args, std::ostream &out);
+};
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Counters on the client's main paths: frames and bytes in and out, time spent parsing received frames and
+// events, time spent blocked on sends, and how many reports are stored.
+// Every thread counts into a block of its own (aligned to a cache line, so threads never share one),
+// and the blocks are only summed up when someone looks. Counting is off until "set stats on":
+// until then every counter is a relaxed load of one flag and a branch.
+class ClientStats
+{
+    public:
+        enum Counter {
+            FRAMES_IN_CONNECTED,
+            FRAMES_IN_MESSAGE,
+            FRAMES_IN_RECEIPT,
+            FRAMES_IN_ERROR,
+            FRAMES_IN_OTHER,
+            FRAMES_OUT_CONNECT,
+            FRAMES_OUT_SUBSCRIBE,
+            FRAMES_OUT_UNSUBSCRIBE,
+            FRAMES_OUT_SEND,
+            FRAMES_OUT_DISCONNECT,
+            FRAMES_OUT_OTHER,
+            BYTES_IN,
+            BYTES_OUT,
+            // Time in processServerFrame (which includes parsing the event of a MESSAGE)
+            SERVER_FRAME_NS,
+            EVENT_PARSES,
+            EVENT_PARSE_NS,
+            // Blocking socket writes (sendBytes and gathered writes) and the time they took
+            SOCKET_WRITES,
+            SOCKET_WRITE_NS,
+            // Producers that waited for room in the send queue, and for how long
+            QUEUE_WAITS,
+            QUEUE_WAIT_NS,
+            COUNTER_COUNT
+        };
+
+        // Values that go up and down rather than only adding up, such as what is held in memory. Every owner
+        // adds its own share (and takes it back when it goes away), so several owners in one process add up.
+        // They are kept up to date whether counting is on or not.
+        enum Gauge {
+            GAMES,
+            STORED_REPORTS,
+            GAUGE_COUNT
+        };
+
+        static bool enabled()
+        {
+            return on.load(std::memory_order_relaxed);
+        }
+
+        static void add(Counter counter, uint64_t amount = 1)
+        {
+            if (enabled()) local().add(counter, amount);
+        }
+
+        static void addGauge(Gauge gauge, int64_t amount)
+        {
+            gauges[gauge].fetch_add(static_cast<uint64_t>(amount), std::memory_order_relaxed);
+        }
+
+        // Counts a frame about to be sent, by its command
+        static void countFrameOut(const char *frame, size_t length)
+        {
+            if (enabled()) local().add(frameOutCounter(frame, length), 1);
+        }
+
+        // The FRAMES_OUT_ counter of a frame, by its command
+        static Counter frameOutCounter(const char *frame, size_t length);
+
+        // Adds the time from construction to destruction to a counter (and 1 to another, if given).
+        // The clock is only read while counting is on.
+        class Timer
+        {
+            private:
+                const Counter nanos;
+                const Counter count;
+                const bool timing;
+                const std::chrono::steady_clock::time_point start;
+
+            public:
+                explicit Timer(Counter nanos, Counter count = COUNTER_COUNT) :
+                    nanos(nanos), count(count), timing(enabled()),
+                    start(timing ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point())
+                {
+                }
+                Timer(const Timer &) = delete;
+                Timer &operator=(const Timer &) = delete;
+
+                ~Timer()
+                {
+                    if (!timing) return;
+                    auto elapsed = std::chrono::steady_clock::now() - start;
+                    ClientStats::add(nanos, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+                    if (count != COUNTER_COUNT) ClientStats::add(count);
+                }
+        };
+
+        // Turns counting on or off. The counts are kept while it is off.
+        static void setEnabled(bool enable);
+        // Appends a line of totals to path every so many seconds (0 stops it). Turns counting on.
+        static void dumpEvery(const std::string &path, unsigned int seconds);
+
+        // The totals of every thread, indexed by Counter
+        static std::vector<uint64_t> totals();
+        // The totals and gauges as one line of name=value pairs (what the dump file gets)
+        static std::string line();
+        // The totals and gauges for a person to read (the "stats" command)
+        static void print(std::ostream &out);
+
+    private:
+        struct alignas(64) Block
+        {
+            // Only the owning thread writes, so an add is a plain load and store (no locked instruction)
+            std::atomic<uint64_t> values[COUNTER_COUNT];
+
+            Block();
+            Block(const Block &) = delete;
+            Block &operator=(const Block &) = delete;
+            // Hands the counts over to the totals of finished threads
+            ~Block();
+
+            void add(Counter counter, uint64_t amount)
+            {
+                values[counter].store(values[counter].load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+            }
+        };
+
+        // The blocks of running threads, the counts of finished ones, and the dump thread
+        struct Registry;
+
+        static std::atomic<bool> on;
+        static std::atomic<uint64_t> gauges[GAUGE_COUNT];
+
+        static Registry &registry();
+        // The calling thread's block, registered on first use
+        static Block &local();
+};
@@ -2,18 +2,110 @@
 
 #include <string>
 #include <iostream>
+#include <vector>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <boost/asio.hpp>
+#include "IoModes.h"
 
 using boost::asio::ip::tcp;
 
+// Result of handing data to the send queue
+enum class SendStatus { QUEUED, DROPPED, WOULD_BLOCK, CLOSED };
+
+// Counters of the send queue, as returned by getSendQueueStats
+struct SendQueueStats {
+	size_t queuedBytes;   // bytes handed to the queue and not written yet (including a write in flight)
+	size_t queuedChunks;
+	size_t peakBytes;     // the deepest the queue has been
+	size_t highWatermark;
+	size_t lowWatermark;
+	size_t writes;        // writes done by the writer thread
+	size_t bytesWritten;
+	size_t blocked;       // times a producer waited for the queue to drain
+	size_t dropped;       // chunks dropped in DROP mode
+	size_t droppedBytes;
+	size_t wouldBlock;    // chunks refused in WOULD_BLOCK mode
+};
+
 class ConnectionHandler {
 private:
 	const std::string host_;
 	const short port_;
 	boost::asio::io_service io_service_;   // Provides core I/O functionality
 	tcp::socket socket_;
+	// Set by shutdown(): reads and writes failing after it are expected and not reported
+	std::atomic<bool> shuttingDown_;
+
+	// Receive buffer: bytes in [inHead_, inTail_) were read from the socket but not consumed yet.
+	// Frames are always kept contiguous - the buffer is compacted (or grown) instead of wrapping.
+	std::vector<char> inBuffer_;
+	size_t inHead_;
+	size_t inTail_;
+	// Bytes after inHead_ already known not to hold the delimiter (relative, so compaction keeps it valid)
+	size_t inScanned_;
+
+	// Asynchronous mode state, only touched by the thread running io_service_
+	char asyncDelimiter_;
+	std::function<void(const char *, size_t)> onFrame_;
+	std::function<void()> onClosed_;
+	// Frames waiting for the write in flight to finish, and the frames of that write
+	std::deque<std::string> outQueue_;
+	std::vector<std::string> outFlight_;
+	bool writing_;
+	// Bytes in outQueue_ and outFlight_. Once they reach the high watermark the asynchronous queue counts
+	// as full until the writes drain it to the low watermark (the same limits as the send queue).
+	size_t outBytes_;
+	bool outFull_;
+
+	// Send queue: chunks written in order by the writer thread (started by the first queueBytes).
+	// Once it holds highWatermark_ bytes it counts as full until the writer drains it to lowWatermark_.
+	mutable std::mutex sendMutex_;
+	std::condition_variable sendReady_;    // signalled when there is something to write (or to stop)
+	std::condition_variable sendDrained_;  // signalled after every write
+	std::deque<std::string> sendQueue_;
+	std::thread writer_;
+	size_t highWatermark_;
+	size_t lowWatermark_;
+	bool sendFull_;
+	bool sendClosed_;   // a write failed or the connection is shut down: nothing more is written
+	bool writerStop_;
+	SendQueueStats sendStats_;
+
+	// The writer thread: writes everything queued so far as one gathered write, until stopped
+	void writerLoop();
+	// Stops the writer thread after it writes what is already queued
+	void stopWriter();
+
+	// Make room at the end of the receive buffer for the next read
+	void prepareBuffer();
+
+	// Read the next chunk from the socket into the receive buffer - blocking.
+	// Returns false in case the connection is closed or the read fails.
+	bool fillBuffer();
+
+	// Take the next complete frame out of the receive buffer, without reading from the socket.
+	// Returns false if the buffer doesn't hold a whole frame yet.
+	bool takeFrame(const char *&data, size_t &length, char delimiter);
+
+	// Start the next asynchronous read / write of the asynchronous mode
+	void asyncReceive();
+	void asyncWriteQueued();
+	// Report a broken connection to the asynchronous mode user, once
+	void asyncClosed();
+
+	// Write a whole sequence of buffers (gathered into writev calls) - blocking.
+	// Returns false in case the connection is closed before all the data is sent.
+	bool sendBuffers(const std::vector<boost::asio::const_buffer> &buffers);
 
 public:
+	// Size of a single socket read on the receive path
+	static const size_t RECEIVE_CHUNK_SIZE = 64 * 1024;
+
 	ConnectionHandler(std::string host, short port);
 
 	virtual ~ConnectionHandler();
@@ -41,11 +133,60 @@ public:
 	// Returns false in case connection closed before null can be read.
 	bool getFrameAscii(std::string &frame, char delimiter);
 
+	// Get the next frame from the server without copying it: data points into the receive buffer
+	// and stays valid only until the next read from this handler. The delimiter is not included.
+	// Returns false in case connection closed before the delimiter can be read.
+	bool getFrameSpan(const char *&data, size_t &length, char delimiter);
+
 	// Send a message to the remote host.
 	// Returns false in case connection is closed before all the data is sent.
 	bool sendFrameAscii(const std::string &frame, char delimiter);
 
+	// Default send queue watermarks, in bytes
+	static const size_t DEFAULT_HIGH_WATERMARK = 1024 * 1024;
+	static const size_t DEFAULT_LOW_WATERMARK = 256 * 1024;
+
+	// Queue data (already delimited frames) to be written by the writer thread, so the caller doesn't wait
+	// for the socket. While the queue is full, mode decides: wait for it to drain to the low watermark,
+	// drop the data or refuse it (WOULD_BLOCK). Returns CLOSED in case the connection is broken.
+	// Don't mix it with the blocking sends below once the writer runs.
+	SendStatus queueBytes(std::string data, OverflowMode mode);
+
+	// Change the send queue watermarks (lowWatermark <= highWatermark). May be called at any time.
+	void setSendQueueLimits(size_t highWatermark, size_t lowWatermark);
+
+	// Wait until everything queued so far is written.
+	// Returns false in case the connection is closed before all the data is sent.
+	bool flushSendQueue();
+
+	SendQueueStats getSendQueueStats() const;
+
+	// Asynchronous mode: instead of blocking calls, the reads and writes below run on the io_service
+	// (getIoService) from the thread that runs it. Don't mix it with the blocking calls above.
+	typedef std::function<void(const char *frame, size_t length)> FrameHandler;
+	typedef std::function<void()> CloseHandler;
+
+	boost::asio::io_service &getIoService();
+
+	// Keep reading frames asynchronously. onFrame gets every complete frame (the data is valid only during
+	// the call) and onClosed is called once when the connection is closed or a read or write fails.
+	void startAsyncReceive(char delimiter, FrameHandler onFrame, CloseHandler onClosed);
+
+	// Queue a message to be sent asynchronously, followed by the delimiter. Messages queued while a
+	// write is in flight go out together in the next write. Empty messages are skipped.
+	void asyncSendFrame(std::string frame, char delimiter);
+
+	// Like asyncSendFrame, but keeps to the send queue watermarks. While the asynchronous queue is full,
+	// mode decides: BLOCK runs the io_service from inside the call (so the writes in flight complete, and
+	// received frames are handled meanwhile) until it drains to the low watermark, DROP drops the message
+	// and WOULD_BLOCK refuses it. Returns CLOSED in case the connection is closed.
+	SendStatus asyncQueueFrame(std::string frame, char delimiter, OverflowMode mode);
+
 	// Close down the connection properly.
 	void close();
 
+	// Shut the socket down for reading and writing, so a read or write blocked in another thread
+	// returns (and fails) right away. Unlike close(), this may be called while another thread uses the handler.
+	void shutdown();
+
 }; //class ConnectionHandler
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Writes console output on a thread of its own, so a slow terminal or pipe never holds up the thread
+// that produces the output (the socket thread). The producer hands over a whole piece of output at a time
+// (e.g. everything printed for one frame) through a lock-free single producer / single consumer ring;
+// the writer thread coalesces whatever is queued into one write(2).
+class ConsoleWriter
+{
+    private:
+        const int fd;
+        // The ring: slots [head, tail) are queued. tail is only written by the producer, head by the writer thread.
+        std::vector<std::string> slots;
+        std::atomic<size_t> head;
+        std::atomic<size_t> tail;
+        std::atomic<bool> stopping;
+        // Set while the writer thread sleeps, so the producer knows to wake it up
+        std::atomic<bool> idle;
+        // Set while the producer waits for room in a full ring, so the writer thread knows to wake it up
+        std::atomic<bool> full;
+        std::mutex mutex;
+        std::condition_variable wakeUp;
+        std::condition_variable room;
+        std::condition_variable written;
+        // Pieces written out so far, for flush()
+        size_t writtenCount;
+        std::thread writer;
+
+        void run();
+        void writeAll(const char *data, size_t length);
+
+    public:
+        explicit ConsoleWriter(int fd, size_t capacity = 1024);
+        ConsoleWriter(const ConsoleWriter &) = delete;
+        ConsoleWriter &operator=(const ConsoleWriter &) = delete;
+        // Writes out whatever is still queued before it returns
+        ~ConsoleWriter();
+
+        // Queues a piece of output. Only one thread may call it (and flush). If the ring is full it waits for room.
+        void write(std::string text);
+        // Waits until everything queued so far is written
+        void flush();
+};
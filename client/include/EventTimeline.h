@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "event.h"
+
+// The events of a game in chronological order: by time, then event name, then arrival.
+// Events may arrive in any order, each insert costs O(log n). The events are immutable and shared,
+// so a reader can take a snapshot (the pointers of a range) and keep using it while more events arrive.
+class EventTimeline
+{
+    public:
+        typedef std::shared_ptr<const Event> EventPtr;
+        typedef std::vector<EventPtr> Snapshot;
+
+        // Where an event is in the timeline. The name is read from the event, so it isn't stored twice.
+        struct Key
+        {
+            int time;
+            // nullptr only in the keys used to look up a time (they come before every event of that time)
+            const Event *event;
+            uint64_t seq;
+
+            Key(int time, const Event *event, uint64_t seq) : time(time), event(event), seq(seq) {}
+            Key(const Key &other) = default;
+            Key &operator=(const Key &other) = default;
+            bool operator<(const Key &other) const;
+        };
+
+        typedef std::map<Key, EventPtr>::const_iterator const_iterator;
+
+        EventTimeline();
+
+        // Puts an event at its place. The returned key stays valid as long as the timeline.
+        const Key &insert(Event &&event);
+
+        size_t size() const;
+        bool empty() const;
+        // The events with fromTime <= time < toTime, in order
+        std::pair<const_iterator, const_iterator> range(int fromTime, int toTime) const;
+
+        // Copies of the event pointers (not of the events), all of them or those of a time range
+        Snapshot snapshot() const;
+        Snapshot snapshot(int fromTime, int toTime) const;
+
+    private:
+        std::map<Key, EventPtr> events;
+        uint64_t nextSeq;
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include "ConnectionHandler.h"
+#include "ClientStats.h"
+
+// Publishes frames through a ConnectionHandler's send queue, coalescing them into large chunks.
+// Frames are buffered until maxFrames frames or maxBytes bytes are pending and then
+// queued together; with maxFrames == 1 every frame is queued on its own.
+// mode says what happens to a chunk while the send queue is full (see ConnectionHandler::queueBytes).
+class FrameBatcher
+{
+    private:
+        ConnectionHandler& handler;
+        const size_t maxFrames;
+        const size_t maxBytes;
+        const char delimiter;
+        const OverflowMode mode;
+        // Pending frames, each one already followed by the delimiter
+        std::string buffer;
+        size_t pendingFrames;
+        // The FRAMES_OUT_ counters of the pending frames (while stats are on), added once their chunk is queued
+        std::vector<ClientStats::Counter> pendingCounters;
+        // Result of the last chunk handed to the send queue
+        SendStatus status;
+
+        // Totals since the first frame was added, for the throughput report (startTime is zero until then)
+        std::chrono::steady_clock::time_point startTime;
+        size_t framesSent;
+        size_t bytesSent;
+        size_t chunks;
+        size_t framesDropped;
+
+        // Hands a chunk of frameCount frames to the send queue
+        bool queue(std::string data, size_t frameCount);
+
+    public:
+        FrameBatcher(ConnectionHandler& handler, size_t maxFrames, size_t maxBytes, char delimiter,
+                     OverflowMode mode = OverflowMode::BLOCK);
+        FrameBatcher(const FrameBatcher&) = delete;
+        FrameBatcher& operator=(const FrameBatcher&) = delete;
+
+        // Adds a frame, queueing the batch when it reaches its budget. Empty frames are skipped.
+        // Returns false in case the batch could not be queued (the connection is closed or, in
+        // WOULD_BLOCK mode, the send queue is full) - getStatus() tells which. Dropped frames are not an error.
+        bool add(const std::string& frame);
+        // Queues whatever is pending. Returns false like add.
+        bool flush();
+
+        SendStatus getStatus() const;
+        size_t getFramesSent() const;
+        // Prints frames/sec and bytes/sec since the first frame was added, and the send queue counters
+        void printStats(std::ostream& out) const;
+};
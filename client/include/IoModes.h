@@ -0,0 +1,15 @@
+#pragma once
+
+// The modes the client options choose between, kept apart from event.h and ConnectionHandler.h
+// so the options don't pull in the json parser or Boost.Asio
+
+// how parseEventsFile reads the file
+enum class EventFileInput {
+    // through a std::ifstream
+    STREAM,
+    // straight from a read-only memory mapping of the file (no copy into a stream buffer)
+    MMAP
+};
+
+// What queueBytes does when the send queue is over its high watermark
+enum class OverflowMode { BLOCK, DROP, WOULD_BLOCK };
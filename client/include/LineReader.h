@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+
+// Reads lines from a file descriptor (the console) while also watching a wake-up descriptor,
+// so a blocked read can be interrupted. Replaces std::getline(std::cin, ...), which can't be.
+class LineReader
+{
+    private:
+        const int fd;
+        std::string buffer;
+        bool endOfInput;
+
+    public:
+        enum Result { LINE, END_OF_INPUT, WOKEN };
+
+        explicit LineReader(int fd);
+
+        // Reads the next line (without its '\n') - blocking until a line is available, the input ends
+        // or wakeFd (if not -1) becomes readable. A pending line is returned before the wake-up is noticed.
+        Result readLine(std::string& line, int wakeFd);
+
+        // Hands over the bytes read ahead of the last line (when switching to another way of reading fd)
+        std::string takePending();
+};
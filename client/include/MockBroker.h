@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+#include "StompFrame.h"
+
+using boost::asio::ip::tcp;
+
+// A small STOMP broker on the loopback interface, for load tests and benchmarks of the client
+// without the Java server. It speaks the subset StompProtocol uses: CONNECT, SUBSCRIBE, UNSUBSCRIBE,
+// SEND (delivered as MESSAGE to every subscriber of the destination), DISCONNECT and receipts.
+// Logins are not checked. Every client gets a thread of its own.
+//
+// It can also record the MESSAGE frames it delivers and replay a recording: a recording is the frames
+// exactly as they go on the wire (each one followed by its null character), and in replay mode every
+// client gets the whole recording right after its first subscription, at a fixed rate or as fast as possible.
+class MockBroker
+{
+    private:
+        struct Session
+        {
+            tcp::socket socket;
+            // Messages to a session are sent from the threads of the sessions that publish them
+            std::mutex writeMutex;
+            std::string user;
+            std::thread thread;
+            // Set by the first SUBSCRIBE, which starts the replay
+            bool subscribed;
+
+            explicit Session(boost::asio::io_service &io) : socket(io), writeMutex(), user(), thread(), subscribed(false) {}
+        };
+        // A subscription: the session and the id it subscribed with
+        typedef std::pair<std::shared_ptr<Session>, std::string> Subscriber;
+
+        boost::asio::io_service io;
+        tcp::acceptor acceptor;
+        std::thread acceptThread;
+        std::atomic<bool> running;
+        // Guards sessions and subscribers
+        std::mutex mutex;
+        std::vector<std::shared_ptr<Session>> sessions;
+        std::multimap<std::string, Subscriber> subscribers;
+        std::atomic<unsigned long long> nextMessageId;
+
+        // Recording: every published MESSAGE once (as sent to its first subscriber)
+        std::mutex recordMutex;
+        std::ofstream recording;
+        // Replay: the recorded frames, and where each one starts in replayData
+        std::string replayData;
+        std::vector<size_t> replayFrames;
+        double replayRate;
+
+        void acceptLoop();
+        // Reads and handles the frames of one client until it disconnects
+        void serve(std::shared_ptr<Session> session);
+        // Returns false once the session is over (DISCONNECT)
+        bool handleFrame(const std::shared_ptr<Session> &session, const FrameView &frame);
+        void publish(const std::string &destination, const Session &from, const TextSpan &body);
+        void unsubscribe(const std::shared_ptr<Session> &session, const std::string &id);
+        // Sends the recording to a session. Returns false if the client is gone.
+        bool replay(Session &session);
+        // Sends a frame (without its null terminator) to a session. Returns false if the client is gone.
+        static bool send(Session &session, const std::string &frame);
+        static bool sendRaw(Session &session, const char *data, size_t length);
+
+    public:
+        MockBroker();
+        MockBroker(const MockBroker &) = delete;
+        MockBroker &operator=(const MockBroker &) = delete;
+        ~MockBroker();
+
+        // Listens on 127.0.0.1:port (0 picks a free port) and starts serving clients.
+        // Returns false if it can't listen.
+        bool start(unsigned short port = 0);
+        // The port it listens on, once started
+        unsigned short getPort() const;
+        // Disconnects every client and waits for all the broker threads
+        void stop();
+
+        // Records the MESSAGE frames published from now on to a file. Returns false if it can't be created.
+        bool record(const std::string &path);
+        // Loads a recording to replay to every client once it subscribes, at framesPerSecond
+        // (0 = as fast as the socket takes it). Returns false if the file can't be read.
+        bool loadReplay(const std::string &path, double framesPerSecond);
+        // Frames in the loaded recording
+        size_t getReplayFrames() const;
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include "event.h"
+
+// Builds the SEND frames of report. The part every frame of a game shares (command, destination,
+// user and team names) is built once and copied in, the size of each frame is computed up front,
+// and the frame is built in a buffer that is reused from frame to frame, so after the first few
+// frames building one doesn't allocate at all.
+class ReportFrameBuilder
+{
+    private:
+        const std::string userName;
+        // The team names the prefix was built for
+        std::string teamA;
+        std::string teamB;
+        std::string prefix;
+        std::string frame;
+
+        void buildPrefix(const Event &event);
+        static size_t updatesSize(const EventUpdates &updates);
+        void appendUpdates(const EventUpdates &updates);
+
+    public:
+        explicit ReportFrameBuilder(const std::string &userName);
+        ReportFrameBuilder(const ReportFrameBuilder &) = delete;
+        ReportFrameBuilder &operator=(const ReportFrameBuilder &) = delete;
+
+        // The SEND frame of an event. The string is overwritten by the next call.
+        const std::string &build(const Event &event);
+};
+
+// Builds the frames of a report on several threads. Events are collected into batches; each batch is
+// split into one slice per thread, every thread builds the frames of its slice with a builder of its own,
+// and the frames are then handed to the sink in the original order - the same bytes the serial path sends.
+// The worker threads are started once and wait for batches, so a batch doesn't pay for creating threads.
+class ParallelReportBuilder
+{
+    public:
+        typedef std::function<bool(const std::string &)> Sink;
+
+        // With threads == 1 the batches are built on the calling thread alone
+        ParallelReportBuilder(const std::string &userName, size_t threads, size_t eventsPerThread = 512);
+        ParallelReportBuilder(const ParallelReportBuilder &) = delete;
+        ParallelReportBuilder &operator=(const ParallelReportBuilder &) = delete;
+        // Stops and joins the workers
+        ~ParallelReportBuilder();
+
+        // Adds an event, building and sending the batch once it is full. Returns false if the sink refused a frame.
+        bool add(Event &&event, const Sink &sink);
+        // Builds and sends the events still pending. Returns false if the sink refused a frame.
+        bool flush(const Sink &sink);
+
+    private:
+        const size_t threads;
+        const size_t batchSize;
+        std::vector<Event> batch;
+        std::vector<std::unique_ptr<ReportFrameBuilder>> builders;
+        // The frames of the current batch, in order; the strings keep their capacity from batch to batch
+        std::vector<std::string> frames;
+
+        // Hands batches to the workers: a new batch bumps generation, and every worker counts pending down when
+        // it is done with its slice
+        std::mutex mutex;
+        std::condition_variable batchReady;
+        std::condition_variable sliceDone;
+        unsigned long long generation;
+        size_t pending;
+        size_t sliceSize;
+        bool stopping;
+        std::vector<std::thread> workers;
+
+        // Builds the frames of the slice of a thread (slice 0 is the calling thread's)
+        void buildSlice(size_t slice);
+        // A worker: builds its slice of every batch until the builder is destroyed
+        void work(size_t slice);
+};
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <atomic>
+
+// Whether the client is logged in, shared by the keyboard thread and the socket thread.
+// The flag is atomic, and stop() also writes to a pipe so that a thread waiting in poll()
+// on wakeFd() (the keyboard thread, see LineReader) wakes up right away instead of on its next line.
+class SessionState
+{
+    private:
+        std::atomic<bool> running;
+        int wakePipe[2];
+
+    public:
+        SessionState();
+        SessionState(const SessionState&) = delete;
+        SessionState& operator=(const SessionState&) = delete;
+        ~SessionState();
+
+        // Marks the session as logged in
+        void start();
+        // Ends the session and wakes up whoever waits on wakeFd(). Safe to call from any thread, more than once.
+        void stop();
+        bool isRunning() const;
+        // Becomes readable once stop() was called
+        int wakeFd() const;
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// A non-owning view of a range of characters (C++11 has no std::string_view)
+struct TextSpan
+{
+    const char *data;
+    size_t size;
+
+    TextSpan();
+    TextSpan(const char *data, size_t size);
+
+    const char *begin() const;
+    const char *end() const;
+    bool empty() const;
+    // True if the span holds exactly the given null terminated string
+    bool equals(const char *text) const;
+    // Copy of the characters, for when the data has to outlive the buffer
+    std::string str() const;
+    // The same span without leading and trailing whitespace (" \t\r\n")
+    TextSpan trimmed() const;
+};
+
+// The headers of a received frame, as views into the frame.
+// The well known STOMP headers get a slot of their own, found with a switch on the header name,
+// so looking them up costs nothing; any other header goes to a small inline list.
+class StompHeaders
+{
+    public:
+        enum Known { DESTINATION, SUBSCRIPTION, MESSAGE_ID, RECEIPT_ID, MESSAGE, USER, KNOWN_COUNT };
+
+        StompHeaders();
+
+        // The slot of a header name, or KNOWN_COUNT if it is not a well known header
+        static Known lookup(const char *name, size_t length);
+
+        // Stores a header (name and value already trimmed). A repeated header replaces the earlier one.
+        void add(TextSpan name, TextSpan value);
+        // Finds a header. Returns false if the frame has no such header.
+        bool get(Known header, TextSpan &value) const;
+        bool get(const char *name, TextSpan &value) const;
+
+    private:
+        struct Header
+        {
+            TextSpan name;
+            TextSpan value;
+
+            Header() : name(), value() {}
+            Header(TextSpan name, TextSpan value) : name(name), value(value) {}
+        };
+        static const size_t INLINE_HEADERS = 8;
+
+        // A slot with a null data pointer is a header the frame doesn't have
+        TextSpan known[KNOWN_COUNT];
+        Header extra[INLINE_HEADERS];
+        size_t extraCount;
+        // Only used by frames with more than INLINE_HEADERS unknown headers
+        std::vector<Header> overflow;
+
+        const Header *findExtra(const char *name, size_t length) const;
+        Header *findExtra(const char *name, size_t length);
+};
+
+// A received STOMP frame split into its parts without copying them.
+// All spans point into the buffer the frame was parsed from (usually the ConnectionHandler
+// receive buffer), so a FrameView is only valid until that buffer is read from again.
+struct FrameView
+{
+    // First line of the frame (CONNECTED, MESSAGE, RECEIPT, ERROR)
+    TextSpan command;
+    // The headers, parsed once by parse()
+    StompHeaders headers;
+    // Everything after the empty line that ends the headers
+    TextSpan body;
+
+    FrameView();
+
+    // Splits a raw frame (without its null terminator) into command, headers and body
+    static FrameView parse(const char *data, size_t size);
+
+    // Finds a header by name. Returns false if the frame has no such header,
+    // otherwise value is set to the trimmed header value.
+    bool header(const char *name, TextSpan &value) const;
+    bool header(StompHeaders::Known name, TextSpan &value) const;
+};
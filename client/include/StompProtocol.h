@@ -2,16 +2,36 @@
 #include <string>
 #include <map>
 #include <vector>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include "../include/ConnectionHandler.h"
 #include "event.h"
+#include "StompFrame.h"
+#include "ClientOptions.h"
+#include "SessionState.h"
+#include "UserReports.h"
+#include "ConsoleWriter.h"
 
 // TODO: implement the STOMP protocol
+// processInput runs on the keyboard thread and processServerFrame on the socket thread;
+// the state both of them touch (receipts, game reports) is locked.
 class StompProtocol
 {
     private:
-        std::map<std::string, std::map<std::string, std::vector<Event>>> gameReports; //to enable summary
+        // The reports of one game, by reporting user. Each game has its own lock, so a summary of one game
+        // only holds up the socket thread while it takes a snapshot of that game's reports.
+        struct GameShard {
+            std::mutex mutex;
+            std::map<std::string, UserReports> reportsByUser;
+            GameShard() : mutex(), reportsByUser() {}
+        };
+        // Guards the map itself (not the shards), held only to find or add a game
+        std::mutex gamesMutex;
+        std::map<std::string, std::unique_ptr<GameShard>> gameReports; //to enable summary
         std::string userName;
-        bool& shouldContinue; // Variable to control the loops
+        SessionState& session; // Stopped on logout and on server errors, ends both client loops
+        const ClientOptions& options; // Settings changed from the console with "set"
         // Counters to generate unique IDs for subscriptions and receipts
         int subscriptionCounter;
         int receiptCounter;
@@ -23,18 +43,54 @@ class StompProtocol
 
         // Maps a Receipt ID to the command that triggered it (e.g., "JOIN", "EXIT", "LOGOUT")
         // This allows the client to print "Joined channel X" when the server sends a RECEIPT
+        // Written by the keyboard thread and read by the socket thread, so it has its own lock
+        std::mutex receiptMutex;
         std::map<int, std::string> receiptToCommand;
 
+        // Reports stored in all the games, this protocol's share of the stored_reports gauge of ClientStats.
+        // Only touched by the socket thread.
+        size_t storedReports;
+
+        // Team names and update keys of the received reports, shared between them; only the socket thread uses it
+        InternTable reportStrings;
+
+        // Everything processServerFrame prints goes through here, written to stdout by a thread of its own
+        ConsoleWriter output;
+
+        // Returns the shard of a game, adding it if create is set (nullptr if it doesn't exist otherwise)
+        GameShard* findGame(const std::string& gameName, bool create);
+        // Takes a snapshot of a user's reports in a game. Returns false if there are none.
+        bool snapshotReports(const std::string& gameName, const std::string& user, ReportsSnapshot& reports);
+
     public:
-        StompProtocol(bool& loggedIn);
+        // Receives the frames built by processInput, returns false to stop
+        typedef std::function<bool(const std::string&)> FrameSink;
+
+        StompProtocol(SessionState& session, const ClientOptions& options);
+        StompProtocol(const StompProtocol&) = delete;
+        StompProtocol& operator=(const StompProtocol&) = delete;
+        // Takes its games and reports back out of the ClientStats gauges
+        ~StompProtocol();
         /**
          * Translates a raw keyboard command (e.g., "join germany") 
-         * into a valid STOMP frame string to be sent to the server.
+         * into valid STOMP frames to be sent to the server. Every frame is passed to sink
+         * as soon as it is built (for report, while the events file is still being parsed).
+         * Returns false if the sink refused a frame.
          */
-        std::vector<std::string> processInput(std::string line);
+        bool processInput(std::string line, const FrameSink& sink);
         /**
          * Processes a STOMP frame received from the server (e.g., MESSAGE, RECEIPT, ERROR)
          * and determines what should be printed to the screen or updated in the state.
          */
         void processServerFrame(std::string frame);
+        /**
+         * Same as above, for a frame that was parsed in place (e.g. in the receive buffer).
+         * Nothing is copied out of the frame except what has to be stored in gameReports.
+         */
+        void processServerFrame(const FrameView& frame);
+        /**
+         * Waits until everything processServerFrame printed is on stdout
+         * (before printing something that must come after it). Call it from the thread that runs processServerFrame.
+         */
+        void flushOutput();
     };
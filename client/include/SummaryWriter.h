@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Writes a summary file through a large buffer of its own, straight with write(2),
+// so the summary text is written out as it is produced instead of being built in one string first.
+// In atomic mode the text goes to a temporary file next to the target that is renamed over it
+// by close(), so nobody ever sees a partly written summary.
+class SummaryWriter
+{
+    private:
+        const std::string path;
+        const bool atomic;
+        // The file actually written (the temporary file in atomic mode)
+        std::string writePath;
+        int fd;
+        std::vector<char> buffer;
+        size_t used;
+        // Set once a write fails, everything after it is dropped
+        bool failed;
+
+        // Writes out length bytes with as many write calls as it takes
+        void writeAll(const char *data, size_t length);
+        void flush();
+        // Closes the file, and removes it if it is an unfinished temporary file
+        void discard();
+
+    public:
+        static const size_t BUFFER_SIZE = 256 * 1024;
+
+        SummaryWriter(const std::string &path, bool atomic);
+        SummaryWriter(const SummaryWriter &) = delete;
+        SummaryWriter &operator=(const SummaryWriter &) = delete;
+        // A writer that wasn't closed leaves no temporary file behind
+        ~SummaryWriter();
+
+        // Creates (or truncates) the file. Returns false if it can't be opened.
+        bool open();
+
+        void append(const char *data, size_t length);
+        void append(const std::string &text);
+        void append(char c);
+        // Appends the decimal digits of a number, without a temporary string
+        void appendNumber(long long number);
+
+        // Writes out what is still buffered and closes the file (renaming it into place in atomic mode).
+        // Returns false if any write failed; the target file is then left untouched in atomic mode.
+        bool close();
+};
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+
+// What the command line tools (StompLoad, StompReplay) share: their clock, "--option value" arguments
+// and keeping stdout for the one result line.
+
+typedef std::chrono::steady_clock Clock;
+
+// Handles one "--option value" pair, returns false for an unknown option
+typedef std::function<bool(const std::string &option, const std::string &value)> OptionHandler;
+
+// Hands every "--option value" pair of the arguments to handle. Returns false if an option has no value
+// or handle refused one.
+bool parseOptions(int argc, char *argv[], const OptionHandler &handle);
+
+// Points stdout at stderr, so what the sessions print (connect messages, receipts) doesn't mix with the
+// result, and returns a stream on the real stdout for the result line
+FILE *openResultStream();
+
+// Writes the result line, followed by a newline, to a stream from openResultStream
+void writeResultLine(FILE *stream, const std::string &line);
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <utility>
+#include <vector>
+#include "event.h"
+#include "EventTimeline.h"
+#include "SummaryWriter.h"
+
+// What a summary needs of a user's reports, taken at one moment: it doesn't change while more reports
+// arrive, so it can be written out without holding the game's lock. The events are shared, not copied.
+struct ReportsSnapshot
+{
+    typedef std::vector<std::pair<std::string, std::string>> Stats;
+
+    EventTimeline::Snapshot events;
+    Stats generalStats;
+    Stats teamAStats;
+    Stats teamBStats;
+
+    ReportsSnapshot();
+
+    // Writes the text of the summary command: the team names, the stats and every report in order.
+    // The text goes to the writer piece by piece, it is never held in memory as a whole.
+    void writeSummary(SummaryWriter &out) const;
+};
+
+// The reports one user sent about one game, kept in a timeline (by time, then event name)
+// together with the game stats they add up to. Both are updated as each report arrives,
+// so a summary only has to write them out instead of sorting and replaying every event.
+class UserReports
+{
+    private:
+        // The latest value of an update, and the event it came from
+        struct Stat
+        {
+            const EventTimeline::Key *from;
+            std::string value;
+
+            Stat(const EventTimeline::Key *from, const std::string &value) : from(from), value(value) {}
+            Stat(const Stat &other) = default;
+            Stat &operator=(const Stat &other) = default;
+        };
+        typedef std::map<std::string, Stat> Stats;
+
+        EventTimeline events;
+        Stats generalStats;
+        Stats teamAStats;
+        Stats teamBStats;
+
+        // Takes the updates of an event, unless an event later in the timeline already set them
+        static void apply(Stats &stats, const EventUpdates &updates, const EventTimeline::Key &from);
+        static void copyStats(ReportsSnapshot::Stats &copy, const Stats &stats);
+
+    public:
+        UserReports();
+        // The stats point into the timeline, so a copy would point into the original
+        UserReports(const UserReports &) = delete;
+        UserReports &operator=(const UserReports &) = delete;
+
+        void add(Event &&event);
+        bool empty() const;
+        const EventTimeline &timeline() const;
+
+        ReportsSnapshot snapshot() const;
+};
@@ -4,38 +4,123 @@
 #include <iostream>
 #include <map>
 #include <vector>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include "IoModes.h"
+
+// pool of the strings that repeat across many events (update keys, team names), so equal strings of
+// different events share one copy. a table belongs to whoever parses the events (a StompProtocol, one
+// parseEventsFile call) and is freed with it; it isn't locked, so only one thread may use it.
+// the events share ownership of the strings, so they stay valid after the table is gone.
+class InternTable
+{
+public:
+    typedef std::shared_ptr<const std::string> Ref;
+
+    // the most strings a table keeps; past that, strings are handed out unshared, so a peer that
+    // keeps sending new keys can't grow the table without bound
+    static const size_t MAX_STRINGS = 4096;
+
+    InternTable();
+    InternTable(const InternTable &other) = delete;
+    InternTable &operator=(const InternTable &other) = delete;
+
+    Ref intern(const std::string &text);
+    Ref intern(const char *data, size_t length);
+
+private:
+    std::unordered_map<std::string, Ref> strings;
+};
+
+// the updates of one section of an event, as a flat vector sorted by key (the same order a
+// std::map would give). keys interned in the same table are shared between events.
+class EventUpdates
+{
+public:
+    typedef std::pair<InternTable::Ref, std::string> Entry;
+
+    // iterates the updates as (key, value) pairs of references, like a std::map iterator
+    class const_iterator
+    {
+    private:
+        std::vector<Entry>::const_iterator it;
+
+    public:
+        explicit const_iterator(std::vector<Entry>::const_iterator it) : it(it) {}
+        std::pair<const std::string &, const std::string &> operator*() const { return {*it->first, it->second}; }
+        const_iterator &operator++()
+        {
+            ++it;
+            return *this;
+        }
+        bool operator==(const const_iterator &other) const { return it == other.it; }
+        bool operator!=(const const_iterator &other) const { return it != other.it; }
+    };
+
+    EventUpdates();
+    // builds the sorted vector from a map in one pass
+    EventUpdates(const std::map<std::string, std::string> &updates);
+    EventUpdates(const EventUpdates &other) = default;
+    EventUpdates(EventUpdates &&other) = default;
+    EventUpdates &operator=(const EventUpdates &other) = default;
+    EventUpdates &operator=(EventUpdates &&other) = default;
+
+    // adds an update, replacing the value if the key is already there
+    void set(InternTable::Ref key, std::string value);
+    void set(const std::string &key, std::string value);
+    // returns the value of key, or nullptr if there is no such update
+    const std::string *find(const std::string &key) const;
+    size_t size() const;
+    bool empty() const;
+    const_iterator begin() const;
+    const_iterator end() const;
+
+private:
+    std::vector<Entry> entries;
+};
 
 class Event
 {
 private:
-    // name of team a
-    std::string team_a_name;
+    // name of team a (interned, when the event was parsed with a table)
+    InternTable::Ref team_a_name;
     // name of team b
-    std::string team_b_name;
+    InternTable::Ref team_b_name;
     // name of the event
     std::string name;
     // time of the event in seconds
     int time;
-    // map of all the general game updates
-    std::map<std::string, std::string> game_updates;
-    // map of all team a updates the second type can be a string bool or int
-    std::map<std::string, std::string> team_a_updates;
-    // map of all team b updates
-    std::map<std::string, std::string> team_b_updates;
+    // all the general game updates
+    EventUpdates game_updates;
+    // all team a updates the second type can be a string bool or int
+    EventUpdates team_a_updates;
+    // all team b updates
+    EventUpdates team_b_updates;
     // description of the event
     std::string description;
 
 public:
-    Event(std::string name, std::string team_a_name, std::string team_b_name, int time, std::map<std::string, std::string> game_updates, std::map<std::string, std::string> team_a_updates, std::map<std::string, std::string> team_b_updates, std::string discription);
-    Event(const std::string & frame_body);
+    // name, the updates and the description are moved in, so pass them with std::move when they are no longer needed.
+    Event(const std::string &team_a_name, const std::string &team_b_name, std::string name, int time, EventUpdates game_updates, EventUpdates team_a_updates, EventUpdates team_b_updates, std::string discription);
+    Event(InternTable::Ref team_a_name, InternTable::Ref team_b_name, std::string name, int time, EventUpdates game_updates, EventUpdates team_a_updates, EventUpdates team_b_updates, std::string discription);
+    // the team names and update keys are interned in strings if it is given
+    Event(const std::string & frame_body, InternTable *strings = nullptr);
+    // Parses a frame body straight from a buffer of length characters (e.g. a FrameView body)
+    Event(const char *frame_body, size_t length, InternTable *strings = nullptr);
+    // copies share the team names and keys
+    Event(const Event &other) = default;
+    Event &operator=(const Event &other) = default;
+    Event(Event &&other) = default;
+    Event &operator=(Event &&other) = default;
     virtual ~Event();
     const std::string &get_team_a_name() const;
     const std::string &get_team_b_name() const;
     const std::string &get_name() const;
     int get_time() const;
-    const std::map<std::string, std::string> &get_game_updates() const;
-    const std::map<std::string, std::string> &get_team_a_updates() const;
-    const std::map<std::string, std::string> &get_team_b_updates() const;
+    const EventUpdates &get_game_updates() const;
+    const EventUpdates &get_team_a_updates() const;
+    const EventUpdates &get_team_b_updates() const;
     const std::string &get_discription() const;
 };
 
@@ -47,4 +132,15 @@ struct names_and_events {
 };
 
 // function that parses the json file and returns a names_and_events object
+// (if the file can't be read, returns whatever was parsed before the failure)
 names_and_events parseEventsFile(std::string json_path);
+
+// called for every event as soon as it has been parsed, returns false to stop the parsing.
+// the event is handed over as an rvalue, so the callback can move it into its final place.
+typedef std::function<bool(Event &&)> EventCallback;
+
+// function that parses the json file incrementally and hands the events one at a time to on_event,
+// so only a single event is held in memory. Returns false if the file couldn't be read or parsed,
+// or if on_event asked to stop.
+bool parseEventsFile(const std::string &json_path, const EventCallback &on_event,
+                     EventFileInput input = EventFileInput::STREAM);
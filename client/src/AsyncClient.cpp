@@ -0,0 +1,108 @@
+#include "../include/AsyncClient.h"
+#include <sstream>
+#include <unistd.h>
+
+AsyncClient::AsyncClient(ConnectionHandler& handler, StompProtocol& protocol, SessionState& session, ClientOptions& options) :
+    handler(handler),
+    protocol(protocol),
+    session(session),
+    options(options),
+    console(handler.getIoService()),
+    consoleBuffer()
+{
+}
+
+bool AsyncClient::openConsole() {
+    int fd = ::dup(STDIN_FILENO);
+    if (fd < 0) return false;
+    boost::system::error_code error;
+    console.assign(fd, error);
+    if (error) {
+        ::close(fd);
+        return false;
+    }
+    return true;
+}
+
+void AsyncClient::run(const std::string& pendingInput) {
+    handler.setSendQueueLimits(options.queueHigh, options.queueLow);
+    handler.startAsyncReceive('\0', [this](const char* frame, size_t length) {
+        handleFrame(frame, length);
+    }, [this]() {
+        protocol.flushOutput();
+        if (session.isRunning()) std::cout << "Disconnected from server" << std::endl;
+        session.stop();
+        finish();
+    });
+
+    // Lines typed before the session started come first; a partial line waits for the rest of it
+    size_t start = 0;
+    size_t newline;
+    while (session.isRunning() && (newline = pendingInput.find('\n', start)) != std::string::npos) {
+        handleLine(pendingInput.substr(start, newline - start));
+        start = newline + 1;
+    }
+    if (session.isRunning()) {
+        std::ostream(&consoleBuffer) << pendingInput.substr(start);
+        readConsole();
+    }
+
+    handler.getIoService().run();
+}
+
+void AsyncClient::readConsole() {
+    boost::asio::async_read_until(console, consoleBuffer, '\n', [this](const boost::system::error_code& error, size_t) {
+        std::istream input(&consoleBuffer);
+        std::string line;
+        if (error) {
+            // At the end of the input the session goes on until the logout receipt (or a disconnect)
+            if (error == boost::asio::error::eof && std::getline(input, line) && session.isRunning()) handleLine(line);
+            return;
+        }
+        std::getline(input, line);
+        handleLine(line);
+        if (session.isRunning()) readConsole();
+    });
+}
+
+void AsyncClient::handleLine(const std::string& line) {
+    std::stringstream ss(line);
+    std::string command;
+    ss >> command;
+    if (command == "set") {
+        options.setFromConsole(ss, std::cout);
+        handler.setSendQueueLimits(options.queueHigh, options.queueLow);
+        return;
+    }
+    // Frames are queued on the handler and written (together) as the socket accepts them. The queue keeps
+    // to the watermarks: a report waits for the writes to drain it (running the io_service meanwhile), so
+    // a large events file is still sent while it is parsed instead of piling up in memory.
+    // Only report may drop or give up on frames while the queue is full, other commands wait for room.
+    OverflowMode overflow = command == "report" ? options.reportOverflow : OverflowMode::BLOCK;
+    SendStatus status = SendStatus::QUEUED;
+    size_t queued = 0;
+    bool sent = protocol.processInput(line, [this, overflow, &status, &queued](const std::string& frame) {
+        status = handler.asyncQueueFrame(frame, '\0', overflow);
+        if (status == SendStatus::QUEUED) queued++;
+        return status == SendStatus::QUEUED || status == SendStatus::DROPPED;
+    });
+    if (!sent && status == SendStatus::WOULD_BLOCK) {
+        std::cout << "Send queue is full, report stopped after " << queued << " events" << std::endl;
+    } else if (!sent && status == SendStatus::CLOSED) {
+        session.stop();
+    }
+    if (!session.isRunning()) finish();
+}
+
+void AsyncClient::handleFrame(const char* frame, size_t length) {
+    protocol.processServerFrame(FrameView::parse(frame, length));
+    if (!session.isRunning()) finish();
+}
+
+void AsyncClient::finish() {
+    boost::system::error_code error;
+    console.cancel(error);
+    console.close(error);
+    handler.shutdown();
+    handler.close();
+}
@@ -0,0 +1,135 @@
+#include "../include/ClientOptions.h"
+#include "../include/ClientStats.h"
+#include "../include/ConnectionHandler.h"
+#include <stdexcept>
+
+ClientOptions::ClientOptions() : batchFrames(256), batchBytes(64 * 1024), eventsInput(EventFileInput::STREAM),
+    queueHigh(ConnectionHandler::DEFAULT_HIGH_WATERMARK), queueLow(ConnectionHandler::DEFAULT_LOW_WATERMARK),
+    reportOverflow(OverflowMode::BLOCK), reportThreads(1), atomicSummary(false), quiet(false),
+    statsFile("client_stats.log"), statsDumpSeconds(0)
+{
+}
+
+// Parses a positive number, returns 0 when value is not one
+static size_t parsePositive(const std::string &value)
+{
+    try {
+        size_t used = 0;
+        long long number = std::stoll(value, &used);
+        if (used != value.size() || number <= 0) return 0;
+        return static_cast<size_t>(number);
+    } catch (const std::exception &) {
+        return 0;
+    }
+}
+
+bool ClientOptions::set(const std::string &option, const std::string &value, std::string &error)
+{
+    if (option == "batch-frames" || option == "batch-bytes") {
+        size_t number = parsePositive(value);
+        if (number == 0) {
+            error = option + " must be a positive number";
+            return false;
+        }
+        if (option == "batch-frames") batchFrames = number;
+        else batchBytes = number;
+        return true;
+    }
+    if (option == "events-input") {
+        if (value == "stream") eventsInput = EventFileInput::STREAM;
+        else if (value == "mmap") eventsInput = EventFileInput::MMAP;
+        else {
+            error = "events-input must be stream or mmap";
+            return false;
+        }
+        return true;
+    }
+    if (option == "queue-high" || option == "queue-low") {
+        size_t number = parsePositive(value);
+        if (number == 0) {
+            error = option + " must be a positive number";
+            return false;
+        }
+        if (option == "queue-high" ? number < queueLow : number > queueHigh) {
+            error = "queue-low must not be above queue-high";
+            return false;
+        }
+        if (option == "queue-high") queueHigh = number;
+        else queueLow = number;
+        return true;
+    }
+    if (option == "report-overflow") {
+        if (value == "block") reportOverflow = OverflowMode::BLOCK;
+        else if (value == "drop") reportOverflow = OverflowMode::DROP;
+        else if (value == "would-block") reportOverflow = OverflowMode::WOULD_BLOCK;
+        else {
+            error = "report-overflow must be block, drop or would-block";
+            return false;
+        }
+        return true;
+    }
+    if (option == "report-threads") {
+        size_t number = parsePositive(value);
+        if (number == 0 || number > 64) {
+            error = "report-threads must be a number from 1 to 64";
+            return false;
+        }
+        reportThreads = number;
+        return true;
+    }
+    if (option == "summary-output") {
+        if (value == "direct") atomicSummary = false;
+        else if (value == "atomic") atomicSummary = true;
+        else {
+            error = "summary-output must be direct or atomic";
+            return false;
+        }
+        return true;
+    }
+    if (option == "quiet") {
+        if (value == "on") quiet = true;
+        else if (value == "off") quiet = false;
+        else {
+            error = "quiet must be on or off";
+            return false;
+        }
+        return true;
+    }
+    // Counting is process wide, so these options take effect right away
+    if (option == "stats") {
+        if (value == "on") ClientStats::setEnabled(true);
+        else if (value == "off") ClientStats::setEnabled(false);
+        else {
+            error = "stats must be on or off";
+            return false;
+        }
+        return true;
+    }
+    if (option == "stats-dump") {
+        size_t seconds = value == "off" ? 0 : parsePositive(value);
+        if (value != "off" && (seconds == 0 || seconds > 86400)) {
+            error = "stats-dump must be off or a number of seconds from 1 to 86400";
+            return false;
+        }
+        statsDumpSeconds = static_cast<unsigned int>(seconds);
+        ClientStats::dumpEvery(statsFile, statsDumpSeconds);
+        return true;
+    }
+    if (option == "stats-file") {
+        statsFile = value;
+        if (statsDumpSeconds > 0) ClientStats::dumpEvery(statsFile, statsDumpSeconds);
+        return true;
+    }
+    error = "Unknown option: " + option;
+    return false;
+}
+
+void ClientOptions::setFromConsole(std::istream &args, std::ostream &out)
+{
+    std::string option, value, error;
+    if (!(args >> option >> value)) {
+        out << "Invalid set command format" << std::endl;
+    } else if (!set(option, value, error)) {
+        out << error << std::endl;
+    }
+}
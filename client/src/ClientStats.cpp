@@ -0,0 +1,167 @@
+#include "../include/ClientStats.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+static const char *COUNTER_NAMES[ClientStats::COUNTER_COUNT] = {
+    "frames_in_connected", "frames_in_message", "frames_in_receipt", "frames_in_error", "frames_in_other",
+    "frames_out_connect", "frames_out_subscribe", "frames_out_unsubscribe", "frames_out_send", "frames_out_disconnect",
+    "frames_out_other", "bytes_in", "bytes_out", "server_frame_ns", "event_parses", "event_parse_ns", "socket_writes",
+    "socket_write_ns", "queue_waits", "queue_wait_ns"
+};
+
+static const char *GAUGE_NAMES[ClientStats::GAUGE_COUNT] = {"games", "stored_reports"};
+
+std::atomic<bool> ClientStats::on(false);
+std::atomic<uint64_t> ClientStats::gauges[ClientStats::GAUGE_COUNT];
+
+struct ClientStats::Registry
+{
+    std::mutex mutex;
+    std::vector<const Block *> blocks;
+    uint64_t finished[COUNTER_COUNT];
+
+    // The dump thread, restarted whenever its settings change
+    std::mutex dumpMutex;
+    std::condition_variable dumpWake;
+    bool dumpStop;
+    std::thread dumper;
+
+    Registry() : mutex(), blocks(), finished(), dumpMutex(), dumpWake(), dumpStop(false), dumper() {}
+    Registry(const Registry &) = delete;
+    Registry &operator=(const Registry &) = delete;
+
+    ~Registry()
+    {
+        stopDumper();
+    }
+
+    void stopDumper()
+    {
+        {
+            std::lock_guard<std::mutex> lock(dumpMutex);
+            dumpStop = true;
+        }
+        dumpWake.notify_one();
+        if (dumper.joinable()) dumper.join();
+        dumpStop = false;
+    }
+
+    void dump(std::string path, unsigned int seconds)
+    {
+        std::unique_lock<std::mutex> lock(dumpMutex);
+        while (!dumpWake.wait_for(lock, std::chrono::seconds(seconds), [this] { return dumpStop; })) {
+            lock.unlock();
+            std::ofstream out(path, std::ios::app);
+            out << ClientStats::line() << '\n';
+            lock.lock();
+        }
+    }
+};
+
+ClientStats::Registry &ClientStats::registry()
+{
+    static Registry instance;
+    return instance;
+}
+
+ClientStats::Block::Block() : values()
+{
+    for (std::atomic<uint64_t> &value : values) value.store(0, std::memory_order_relaxed);
+    Registry &all = registry();
+    std::lock_guard<std::mutex> lock(all.mutex);
+    all.blocks.push_back(this);
+}
+
+ClientStats::Block::~Block()
+{
+    Registry &all = registry();
+    std::lock_guard<std::mutex> lock(all.mutex);
+    for (size_t i = 0; i < COUNTER_COUNT; i++) all.finished[i] += values[i].load(std::memory_order_relaxed);
+    all.blocks.erase(std::remove(all.blocks.begin(), all.blocks.end(), this), all.blocks.end());
+}
+
+ClientStats::Block &ClientStats::local()
+{
+    static thread_local Block block;
+    return block;
+}
+
+ClientStats::Counter ClientStats::frameOutCounter(const char *frame, size_t length)
+{
+    // The commands the client sends tell apart by their first characters
+    if (length >= 4 && std::memcmp(frame, "SEND", 4) == 0) return FRAMES_OUT_SEND;
+    if (length >= 9 && std::memcmp(frame, "SUBSCRIBE", 9) == 0) return FRAMES_OUT_SUBSCRIBE;
+    if (length >= 11 && std::memcmp(frame, "UNSUBSCRIBE", 11) == 0) return FRAMES_OUT_UNSUBSCRIBE;
+    if (length >= 10 && std::memcmp(frame, "DISCONNECT", 10) == 0) return FRAMES_OUT_DISCONNECT;
+    if (length >= 7 && std::memcmp(frame, "CONNECT", 7) == 0) return FRAMES_OUT_CONNECT;
+    return FRAMES_OUT_OTHER;
+}
+
+void ClientStats::setEnabled(bool enable)
+{
+    on.store(enable, std::memory_order_relaxed);
+}
+
+void ClientStats::dumpEvery(const std::string &path, unsigned int seconds)
+{
+    Registry &all = registry();
+    all.stopDumper();
+    if (seconds == 0) return;
+    setEnabled(true);
+    all.dumper = std::thread(&Registry::dump, &all, path, seconds);
+}
+
+std::vector<uint64_t> ClientStats::totals()
+{
+    Registry &all = registry();
+    std::lock_guard<std::mutex> lock(all.mutex);
+    std::vector<uint64_t> sums(all.finished, all.finished + COUNTER_COUNT);
+    for (const Block *block : all.blocks) {
+        for (size_t i = 0; i < COUNTER_COUNT; i++) sums[i] += block->values[i].load(std::memory_order_relaxed);
+    }
+    return sums;
+}
+
+std::string ClientStats::line()
+{
+    std::vector<uint64_t> sums = totals();
+    std::ostringstream out;
+    out << "time=" << std::time(nullptr);
+    for (size_t i = 0; i < COUNTER_COUNT; i++) out << ' ' << COUNTER_NAMES[i] << '=' << sums[i];
+    for (size_t i = 0; i < GAUGE_COUNT; i++) out << ' ' << GAUGE_NAMES[i] << '=' << gauges[i].load(std::memory_order_relaxed);
+    return out.str();
+}
+
+// The average of a total over a count, 0 if there is nothing to average
+static uint64_t average(uint64_t total, uint64_t count)
+{
+    return count == 0 ? 0 : total / count;
+}
+
+void ClientStats::print(std::ostream &out)
+{
+    std::vector<uint64_t> sums = totals();
+    uint64_t framesIn = 0;
+    for (size_t i = FRAMES_IN_CONNECTED; i <= FRAMES_IN_OTHER; i++) framesIn += sums[i];
+    out << "Stats (counting " << (enabled() ? "on" : "off") << ")\n"
+        << "Frames in: " << sums[FRAMES_IN_CONNECTED] << " CONNECTED, " << sums[FRAMES_IN_MESSAGE] << " MESSAGE, "
+        << sums[FRAMES_IN_RECEIPT] << " RECEIPT, " << sums[FRAMES_IN_ERROR] << " ERROR, " << sums[FRAMES_IN_OTHER]
+        << " other\n"
+        << "Frames out: " << sums[FRAMES_OUT_CONNECT] << " CONNECT, " << sums[FRAMES_OUT_SUBSCRIBE] << " SUBSCRIBE, "
+        << sums[FRAMES_OUT_UNSUBSCRIBE] << " UNSUBSCRIBE, " << sums[FRAMES_OUT_SEND] << " SEND, "
+        << sums[FRAMES_OUT_DISCONNECT] << " DISCONNECT, " << sums[FRAMES_OUT_OTHER] << " other\n"
+        << "Bytes: " << sums[BYTES_IN] << " in, " << sums[BYTES_OUT] << " out\n"
+        << "processServerFrame: " << average(sums[SERVER_FRAME_NS], framesIn) << " ns per frame\n"
+        << "Event parsing: " << sums[EVENT_PARSES] << " events, " << average(sums[EVENT_PARSE_NS], sums[EVENT_PARSES])
+        << " ns per event\n"
+        << "Socket writes: " << sums[SOCKET_WRITES] << ", " << sums[SOCKET_WRITE_NS] / 1000 << " us blocked\n"
+        << "Send queue waits: " << sums[QUEUE_WAITS] << ", " << sums[QUEUE_WAIT_NS] / 1000 << " us blocked\n"
+        << "Stored reports: " << gauges[STORED_REPORTS].load(std::memory_order_relaxed) << " in "
+        << gauges[GAMES].load(std::memory_order_relaxed) << " games" << std::endl;
+}
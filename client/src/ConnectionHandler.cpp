@@ -1,4 +1,7 @@
 #include "../include/ConnectionHandler.h"
+#include "../include/ClientStats.h"
+#include <algorithm>
+#include <cstring>
 
 using boost::asio::ip::tcp;
 
@@ -9,7 +12,16 @@ using std::endl;
 using std::string;
 
 ConnectionHandler::ConnectionHandler(string host, short port) : host_(host), port_(port), io_service_(),
-                                                                socket_(io_service_) {}
+                                                                socket_(io_service_), shuttingDown_(false), inBuffer_(RECEIVE_CHUNK_SIZE),
+                                                                inHead_(0), inTail_(0), inScanned_(0), asyncDelimiter_('\0'),
+                                                                onFrame_(), onClosed_(), outQueue_(), outFlight_(),
+                                                                writing_(false), outBytes_(0), outFull_(false), sendMutex_(), sendReady_(), sendDrained_(),
+                                                                sendQueue_(), writer_(), highWatermark_(DEFAULT_HIGH_WATERMARK),
+                                                                lowWatermark_(DEFAULT_LOW_WATERMARK), sendFull_(false),
+                                                                sendClosed_(false), writerStop_(false), sendStats_() {
+	sendStats_.highWatermark = highWatermark_;
+	sendStats_.lowWatermark = lowWatermark_;
+}
 
 ConnectionHandler::~ConnectionHandler() {
 	close();
@@ -34,15 +46,46 @@ bool ConnectionHandler::connect() {
 
 bool ConnectionHandler::getBytes(char bytes[], unsigned int bytesToRead) {
 	size_t tmp = 0;
+	while (bytesToRead > tmp) {
+		// Serve whatever is already buffered before going back to the socket
+		if (inHead_ == inTail_ && !fillBuffer())
+			return false;
+		size_t chunk = std::min(static_cast<size_t>(bytesToRead - tmp), inTail_ - inHead_);
+		std::memcpy(bytes + tmp, &inBuffer_[inHead_], chunk);
+		inHead_ += chunk;
+		inScanned_ = inScanned_ > chunk ? inScanned_ - chunk : 0;
+		tmp += chunk;
+	}
+	return true;
+}
+
+void ConnectionHandler::prepareBuffer() {
+	if (inHead_ == inTail_) {
+		inHead_ = inTail_ = 0;
+	} else if (inTail_ == inBuffer_.size()) {
+		// No room at the end: move the pending bytes to the front, or grow if they fill the whole buffer
+		if (inHead_ > 0) {
+			std::memmove(&inBuffer_[0], &inBuffer_[inHead_], inTail_ - inHead_);
+			inTail_ -= inHead_;
+			inHead_ = 0;
+		} else {
+			inBuffer_.resize(inBuffer_.size() * 2);
+		}
+	}
+}
+
+bool ConnectionHandler::fillBuffer() {
+	prepareBuffer();
 	boost::system::error_code error;
 	try {
-		while (!error && bytesToRead > tmp) {
-			tmp += socket_.read_some(boost::asio::buffer(bytes + tmp, bytesToRead - tmp), error);
-		}
+		size_t bytes = socket_.read_some(boost::asio::buffer(&inBuffer_[inTail_], inBuffer_.size() - inTail_), error);
 		if (error)
 			throw boost::system::system_error(error);
+		inTail_ += bytes;
+		ClientStats::add(ClientStats::BYTES_IN, bytes);
 	} catch (std::exception &e) {
-		std::cerr << "recv failed (Error: " << e.what() << ')' << std::endl;
+		if (!shuttingDown_)
+			std::cerr << "recv failed (Error: " << e.what() << ')' << std::endl;
 		return false;
 	}
 	return true;
@@ -52,13 +95,16 @@ bool ConnectionHandler::sendBytes(const char bytes[], int bytesToWrite) {
 	int tmp = 0;
 	boost::system::error_code error;
 	try {
+		ClientStats::Timer timer(ClientStats::SOCKET_WRITE_NS, ClientStats::SOCKET_WRITES);
 		while (!error && bytesToWrite > tmp) {
 			tmp += socket_.write_some(boost::asio::buffer(bytes + tmp, bytesToWrite - tmp), error);
 		}
+		ClientStats::add(ClientStats::BYTES_OUT, tmp);
 		if (error)
 			throw boost::system::system_error(error);
 	} catch (std::exception &e) {
-		std::cerr << "recv failed (Error: " << e.what() << ')' << std::endl;
+		if (!shuttingDown_)
+			std::cerr << "recv failed (Error: " << e.what() << ')' << std::endl;
 		return false;
 	}
 	return true;
@@ -74,35 +120,319 @@ bool ConnectionHandler::sendLine(std::string &line) {
 
 
 bool ConnectionHandler::getFrameAscii(std::string &frame, char delimiter) {
-	char ch;
-	// Stop when we encounter the null character.
-	// Notice that the null character is not appended to the frame string.
+	const char *data;
+	size_t length;
+	if (!getFrameSpan(data, length, delimiter))
+		return false;
+	// Notice that null characters (and so a null delimiter) are not appended to the frame string.
+	const char *stop = data + length;
+	frame.reserve(frame.size() + length + 1);
+	while (data < stop) {
+		const char *nul = static_cast<const char *>(std::memchr(data, '\0', stop - data));
+		if (nul == nullptr)
+			nul = stop;
+		frame.append(data, nul);
+		data = nul + 1;
+	}
+	if (delimiter != '\0')
+		frame.append(1, delimiter);
+	return true;
+}
+
+bool ConnectionHandler::getFrameSpan(const char *&data, size_t &length, char delimiter) {
+	// Read more from the socket only while the buffered bytes don't hold a whole frame
+	while (!takeFrame(data, length, delimiter)) {
+		if (!fillBuffer())
+			return false;
+	}
+	return true;
+}
+
+bool ConnectionHandler::takeFrame(const char *&data, size_t &length, char delimiter) {
+	// Only the bytes that arrived since the last look are scanned
+	if (inHead_ + inScanned_ >= inTail_)
+		return false;
+	const char *from = &inBuffer_[inHead_ + inScanned_];
+	const char *end = static_cast<const char *>(std::memchr(from, delimiter, inTail_ - inHead_ - inScanned_));
+	if (end == nullptr) {
+		inScanned_ = inTail_ - inHead_;
+		return false;
+	}
+	data = &inBuffer_[inHead_];
+	length = end - data;
+	// The bytes are consumed but left in place - they are only overwritten by the next read
+	inHead_ += length + 1;
+	inScanned_ = 0;
+	return true;
+}
+
+bool ConnectionHandler::sendFrameAscii(const std::string &frame, char delimiter) {
+	ClientStats::countFrameOut(frame.data(), frame.size());
+	// The frame and its delimiter go out in a single write
+	std::vector<boost::asio::const_buffer> buffers;
+	buffers.push_back(boost::asio::buffer(frame));
+	buffers.push_back(boost::asio::buffer(&delimiter, 1));
+	return sendBuffers(buffers);
+}
+
+bool ConnectionHandler::sendBuffers(const std::vector<boost::asio::const_buffer> &buffers) {
+	boost::system::error_code error;
 	try {
-		do {
-			if (!getBytes(&ch, 1)) {
-				return false;
-			}
-			if (ch != '\0')
-				frame.append(1, ch);
-		} while (delimiter != ch);
+		ClientStats::Timer timer(ClientStats::SOCKET_WRITE_NS, ClientStats::SOCKET_WRITES);
+		ClientStats::add(ClientStats::BYTES_OUT, boost::asio::write(socket_, buffers, error));
+		if (error)
+			throw boost::system::system_error(error);
 	} catch (std::exception &e) {
-		std::cerr << "recv failed2 (Error: " << e.what() << ')' << std::endl;
+		if (!shuttingDown_)
+			std::cerr << "send failed (Error: " << e.what() << ')' << std::endl;
 		return false;
 	}
 	return true;
 }
 
-bool ConnectionHandler::sendFrameAscii(const std::string &frame, char delimiter) {
-	bool result = sendBytes(frame.c_str(), frame.length());
-	if (!result) return false;
-	return sendBytes(&delimiter, 1);
+SendStatus ConnectionHandler::queueBytes(std::string data, OverflowMode mode) {
+	std::unique_lock<std::mutex> lock(sendMutex_);
+	if (sendClosed_)
+		return SendStatus::CLOSED;
+	if (data.empty())
+		return SendStatus::QUEUED;
+	if (sendFull_) {
+		if (mode == OverflowMode::DROP) {
+			sendStats_.dropped++;
+			sendStats_.droppedBytes += data.size();
+			return SendStatus::DROPPED;
+		}
+		if (mode == OverflowMode::WOULD_BLOCK) {
+			sendStats_.wouldBlock++;
+			return SendStatus::WOULD_BLOCK;
+		}
+		sendStats_.blocked++;
+		ClientStats::Timer timer(ClientStats::QUEUE_WAIT_NS, ClientStats::QUEUE_WAITS);
+		sendDrained_.wait(lock, [this] { return !sendFull_ || sendClosed_; });
+		if (sendClosed_)
+			return SendStatus::CLOSED;
+	}
+	if (!writer_.joinable())
+		writer_ = std::thread(&ConnectionHandler::writerLoop, this);
+	// A single chunk is always taken, even if it is bigger than the high watermark by itself
+	sendStats_.queuedBytes += data.size();
+	sendStats_.queuedChunks++;
+	sendStats_.peakBytes = std::max(sendStats_.peakBytes, sendStats_.queuedBytes);
+	if (sendStats_.queuedBytes >= highWatermark_)
+		sendFull_ = true;
+	sendQueue_.push_back(std::move(data));
+	sendReady_.notify_one();
+	return SendStatus::QUEUED;
+}
+
+void ConnectionHandler::setSendQueueLimits(size_t highWatermark, size_t lowWatermark) {
+	std::lock_guard<std::mutex> lock(sendMutex_);
+	highWatermark_ = highWatermark;
+	lowWatermark_ = std::min(lowWatermark, highWatermark);
+	sendStats_.highWatermark = highWatermark_;
+	sendStats_.lowWatermark = lowWatermark_;
+	sendFull_ = sendStats_.queuedBytes >= highWatermark_ || (sendFull_ && sendStats_.queuedBytes > lowWatermark_);
+	outFull_ = outBytes_ >= highWatermark_ || (outFull_ && outBytes_ > lowWatermark_);
+	sendDrained_.notify_all();
+}
+
+bool ConnectionHandler::flushSendQueue() {
+	std::unique_lock<std::mutex> lock(sendMutex_);
+	sendDrained_.wait(lock, [this] { return sendStats_.queuedBytes == 0 || sendClosed_; });
+	return !sendClosed_;
+}
+
+SendQueueStats ConnectionHandler::getSendQueueStats() const {
+	std::lock_guard<std::mutex> lock(sendMutex_);
+	return sendStats_;
+}
+
+void ConnectionHandler::writerLoop() {
+	std::unique_lock<std::mutex> lock(sendMutex_);
+	std::vector<std::string> batch;
+	std::vector<boost::asio::const_buffer> buffers;
+	while (true) {
+		sendReady_.wait(lock, [this] { return !sendQueue_.empty() || writerStop_ || sendClosed_; });
+		if (sendClosed_ || sendQueue_.empty())
+			break;
+		// Everything queued so far goes out as one gathered write, without holding the lock
+		batch.assign(std::make_move_iterator(sendQueue_.begin()), std::make_move_iterator(sendQueue_.end()));
+		sendQueue_.clear();
+		lock.unlock();
+		size_t bytes = 0;
+		buffers.clear();
+		for (const std::string &chunk : batch) {
+			buffers.push_back(boost::asio::buffer(chunk));
+			bytes += chunk.size();
+		}
+		bool sent = sendBuffers(buffers);
+		lock.lock();
+		sendStats_.queuedBytes -= bytes;
+		sendStats_.queuedChunks -= batch.size();
+		if (sent) {
+			sendStats_.writes++;
+			sendStats_.bytesWritten += bytes;
+		} else {
+			sendClosed_ = true;
+		}
+		if (sendFull_ && sendStats_.queuedBytes <= lowWatermark_)
+			sendFull_ = false;
+		sendDrained_.notify_all();
+	}
+	// Whatever is left will never be written
+	sendStats_.queuedBytes = 0;
+	sendStats_.queuedChunks = 0;
+	sendQueue_.clear();
+	sendDrained_.notify_all();
+}
+
+void ConnectionHandler::stopWriter() {
+	{
+		std::lock_guard<std::mutex> lock(sendMutex_);
+		writerStop_ = true;
+		sendReady_.notify_one();
+	}
+	if (writer_.joinable() && writer_.get_id() != std::this_thread::get_id())
+		writer_.join();
+	std::lock_guard<std::mutex> lock(sendMutex_);
+	sendClosed_ = true;
+}
+
+boost::asio::io_service &ConnectionHandler::getIoService() {
+	return io_service_;
+}
+
+void ConnectionHandler::startAsyncReceive(char delimiter, FrameHandler onFrame, CloseHandler onClosed) {
+	asyncDelimiter_ = delimiter;
+	onFrame_ = onFrame;
+	onClosed_ = onClosed;
+	asyncReceive();
+}
+
+void ConnectionHandler::asyncReceive() {
+	prepareBuffer();
+	socket_.async_read_some(boost::asio::buffer(&inBuffer_[inTail_], inBuffer_.size() - inTail_),
+	                        [this](const boost::system::error_code &error, size_t bytes) {
+		if (error) {
+			if (!shuttingDown_ && error != boost::asio::error::operation_aborted && error != boost::asio::error::eof)
+				std::cerr << "recv failed (Error: " << error.message() << ')' << std::endl;
+			asyncClosed();
+			return;
+		}
+		inTail_ += bytes;
+		ClientStats::add(ClientStats::BYTES_IN, bytes);
+		// Hand out every frame this read completed, then read again
+		const char *data;
+		size_t length;
+		while (socket_.is_open() && takeFrame(data, length, asyncDelimiter_))
+			onFrame_(data, length);
+		if (socket_.is_open())
+			asyncReceive();
+	});
+}
+
+void ConnectionHandler::asyncSendFrame(std::string frame, char delimiter) {
+	if (frame.empty())
+		return;
+	ClientStats::countFrameOut(frame.data(), frame.size());
+	frame += delimiter;
+	outBytes_ += frame.size();
+	std::unique_lock<std::mutex> lock(sendMutex_);
+	if (outBytes_ >= highWatermark_)
+		outFull_ = true;
+	sendStats_.peakBytes = std::max(sendStats_.peakBytes, outBytes_);
+	lock.unlock();
+	outQueue_.push_back(std::move(frame));
+	if (!writing_)
+		asyncWriteQueued();
+}
+
+SendStatus ConnectionHandler::asyncQueueFrame(std::string frame, char delimiter, OverflowMode mode) {
+	if (!socket_.is_open())
+		return SendStatus::CLOSED;
+	if (outFull_) {
+		std::unique_lock<std::mutex> lock(sendMutex_);
+		if (mode == OverflowMode::DROP) {
+			sendStats_.dropped++;
+			sendStats_.droppedBytes += frame.size() + 1;
+			return SendStatus::DROPPED;
+		}
+		if (mode == OverflowMode::WOULD_BLOCK) {
+			sendStats_.wouldBlock++;
+			return SendStatus::WOULD_BLOCK;
+		}
+		sendStats_.blocked++;
+		lock.unlock();
+		ClientStats::Timer timer(ClientStats::QUEUE_WAIT_NS, ClientStats::QUEUE_WAITS);
+		// A write is in flight while the queue is full, so run_one has a handler to wait for. The caller runs
+		// on the io_service thread itself, which is the only one that ever runs it, so this can't deadlock.
+		while (outFull_ && socket_.is_open()) {
+			if (io_service_.run_one() == 0)
+				break;
+		}
+		if (outFull_ || !socket_.is_open())
+			return SendStatus::CLOSED;
+	}
+	asyncSendFrame(std::move(frame), delimiter);
+	return SendStatus::QUEUED;
+}
+
+void ConnectionHandler::asyncWriteQueued() {
+	// Everything queued so far goes out as one gathered write
+	outFlight_.assign(std::make_move_iterator(outQueue_.begin()), std::make_move_iterator(outQueue_.end()));
+	outQueue_.clear();
+	std::vector<boost::asio::const_buffer> buffers;
+	buffers.reserve(outFlight_.size());
+	for (const std::string &frame : outFlight_)
+		buffers.push_back(boost::asio::buffer(frame));
+	writing_ = true;
+	boost::asio::async_write(socket_, buffers, [this](const boost::system::error_code &error, size_t bytes) {
+		writing_ = false;
+		ClientStats::add(ClientStats::BYTES_OUT, bytes);
+		for (const std::string &frame : outFlight_)
+			outBytes_ -= frame.size();
+		outFlight_.clear();
+		{
+			std::lock_guard<std::mutex> lock(sendMutex_);
+			if (outBytes_ <= lowWatermark_)
+				outFull_ = false;
+		}
+		if (error) {
+			if (!shuttingDown_ && error != boost::asio::error::operation_aborted)
+				std::cerr << "send failed (Error: " << error.message() << ')' << std::endl;
+			asyncClosed();
+			return;
+		}
+		if (!outQueue_.empty())
+			asyncWriteQueued();
+	});
+}
+
+void ConnectionHandler::asyncClosed() {
+	if (!onClosed_)
+		return;
+	CloseHandler onClosed = onClosed_;
+	onClosed_ = CloseHandler();
+	onClosed();
 }
 
 // Close down the connection properly.
 void ConnectionHandler::close() {
+	stopWriter();
 	try {
 		socket_.close();
 	} catch (...) {
 		std::cout << "closing failed: connection already closed" << std::endl;
 	}
 }
+
+void ConnectionHandler::shutdown() {
+	shuttingDown_ = true;
+	boost::system::error_code error;
+	socket_.shutdown(tcp::socket::shutdown_both, error); // fails only if the socket is already gone
+	// Producers waiting for the send queue to drain give up, and the writer stops
+	std::lock_guard<std::mutex> lock(sendMutex_);
+	sendClosed_ = true;
+	sendReady_.notify_one();
+	sendDrained_.notify_all();
+}
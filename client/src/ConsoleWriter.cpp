@@ -0,0 +1,112 @@
+#include "../include/ConsoleWriter.h"
+#include <cerrno>
+#include <unistd.h>
+
+ConsoleWriter::ConsoleWriter(int fd, size_t capacity) :
+    fd(fd),
+    slots(capacity > 0 ? capacity : 1),
+    head(0),
+    tail(0),
+    stopping(false),
+    idle(false),
+    full(false),
+    mutex(),
+    wakeUp(),
+    room(),
+    written(),
+    writtenCount(0),
+    writer()
+{
+    writer = std::thread(&ConsoleWriter::run, this);
+}
+
+ConsoleWriter::~ConsoleWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeUp.notify_one();
+    writer.join();
+}
+
+void ConsoleWriter::write(std::string text)
+{
+    if (text.empty()) return;
+    size_t slot = tail.load(std::memory_order_relaxed);
+    // Full: the writer thread is behind, wait for it to free a slot (output is never dropped)
+    if (slot - head.load(std::memory_order_acquire) >= slots.size()) {
+        std::unique_lock<std::mutex> lock(mutex);
+        // Sequentially consistent with the writer advancing head and looking at full, so one of us sees the other
+        full = true;
+        room.wait(lock, [this, slot] { return slot - head.load() < slots.size(); });
+        full = false;
+    }
+    slots[slot % slots.size()] = std::move(text);
+    // Sequentially consistent with the writer setting idle and looking at tail again, so one of us sees the other
+    tail.store(slot + 1);
+    if (idle.load()) {
+        std::lock_guard<std::mutex> lock(mutex);
+        wakeUp.notify_one();
+    }
+}
+
+void ConsoleWriter::flush()
+{
+    size_t queued = tail.load(std::memory_order_relaxed);
+    std::unique_lock<std::mutex> lock(mutex);
+    wakeUp.notify_one();
+    written.wait(lock, [this, queued] { return writtenCount >= queued; });
+}
+
+void ConsoleWriter::run()
+{
+    std::string buffer;
+    while (true) {
+        size_t first = head.load(std::memory_order_relaxed);
+        size_t last = tail.load(std::memory_order_acquire);
+        if (first == last) {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (stopping) break;
+            idle = true;
+            // The producer may have queued something between the check and idle being set. Otherwise it sees
+            // idle and notifies under the lock, so the wake up can't be missed and no timeout is needed.
+            if (tail.load() == first) {
+                wakeUp.wait(lock);
+            }
+            idle = false;
+            continue;
+        }
+
+        // Everything queued so far goes out in one write
+        buffer.clear();
+        for (size_t i = first; i < last; i++) {
+            std::string &slot = slots[i % slots.size()];
+            buffer += slot;
+            slot.clear();
+        }
+        head.store(last);
+        if (full.load()) {
+            std::lock_guard<std::mutex> lock(mutex);
+            room.notify_one();
+        }
+        writeAll(buffer.data(), buffer.size());
+
+        std::lock_guard<std::mutex> lock(mutex);
+        writtenCount = last;
+        written.notify_all();
+    }
+}
+
+void ConsoleWriter::writeAll(const char *data, size_t length)
+{
+    while (length > 0) {
+        ssize_t bytes = ::write(fd, data, length);
+        if (bytes < 0) {
+            if (errno == EINTR) continue;
+            return; // stdout is gone, nothing to report it to
+        }
+        data += bytes;
+        length -= bytes;
+    }
+}
@@ -0,0 +1,54 @@
+#include "../include/EventTimeline.h"
+
+bool EventTimeline::Key::operator<(const Key &other) const
+{
+    if (time != other.time) return time < other.time;
+    if (event == nullptr || other.event == nullptr) return event == nullptr && other.event != nullptr;
+    int byName = event->get_name().compare(other.event->get_name());
+    if (byName != 0) return byName < 0;
+    return seq < other.seq;
+}
+
+EventTimeline::EventTimeline() : events(), nextSeq(0)
+{
+}
+
+const EventTimeline::Key &EventTimeline::insert(Event &&event)
+{
+    EventPtr shared = std::make_shared<const Event>(std::move(event));
+    Key key(shared->get_time(), shared.get(), nextSeq++);
+    // The sequence number makes every key unique, so this always inserts
+    return events.emplace(key, std::move(shared)).first->first;
+}
+
+size_t EventTimeline::size() const
+{
+    return events.size();
+}
+
+bool EventTimeline::empty() const
+{
+    return events.empty();
+}
+
+std::pair<EventTimeline::const_iterator, EventTimeline::const_iterator> EventTimeline::range(int fromTime, int toTime) const
+{
+    if (toTime <= fromTime) return std::make_pair(events.end(), events.end());
+    return std::make_pair(events.lower_bound(Key(fromTime, nullptr, 0)), events.lower_bound(Key(toTime, nullptr, 0)));
+}
+
+EventTimeline::Snapshot EventTimeline::snapshot() const
+{
+    Snapshot copy;
+    copy.reserve(events.size());
+    for (auto const &entry : events) copy.push_back(entry.second);
+    return copy;
+}
+
+EventTimeline::Snapshot EventTimeline::snapshot(int fromTime, int toTime) const
+{
+    Snapshot copy;
+    auto bounds = range(fromTime, toTime);
+    for (auto it = bounds.first; it != bounds.second; ++it) copy.push_back(it->second);
+    return copy;
+}
@@ -0,0 +1,100 @@
+#include "../include/FrameBatcher.h"
+#include "../include/ClientStats.h"
+
+FrameBatcher::FrameBatcher(ConnectionHandler& handler, size_t maxFrames, size_t maxBytes, char delimiter,
+                           OverflowMode mode) :
+    handler(handler),
+    maxFrames(maxFrames),
+    maxBytes(maxBytes),
+    delimiter(delimiter),
+    mode(mode),
+    buffer(),
+    pendingFrames(0),
+    pendingCounters(),
+    status(SendStatus::QUEUED),
+    startTime(),
+    framesSent(0),
+    bytesSent(0),
+    chunks(0),
+    framesDropped(0)
+{
+    if (maxFrames > 1) buffer.reserve(maxBytes + 1);
+}
+
+bool FrameBatcher::add(const std::string& frame) {
+    if (frame.empty()) return true;
+    // The clock starts at the first frame rather than at construction, so the setup before it isn't counted
+    if (startTime == std::chrono::steady_clock::time_point()) startTime = std::chrono::steady_clock::now();
+    if (ClientStats::enabled()) pendingCounters.push_back(ClientStats::frameOutCounter(frame.data(), frame.size()));
+
+    // Per-frame path: every frame is a chunk of its own
+    if (maxFrames <= 1) {
+        std::string data;
+        data.reserve(frame.size() + 1);
+        data += frame;
+        data += delimiter;
+        return queue(std::move(data), 1);
+    }
+
+    buffer += frame;
+    buffer += delimiter;
+    pendingFrames++;
+    if (pendingFrames >= maxFrames || buffer.size() >= maxBytes) return flush();
+    return true;
+}
+
+bool FrameBatcher::flush() {
+    if (pendingFrames == 0) return true;
+    size_t frameCount = pendingFrames;
+    std::string data;
+    data.swap(buffer);
+    pendingFrames = 0;
+    // The queue keeps the chunk, the next batch gets a fresh buffer
+    buffer.reserve(maxBytes + 1);
+    return queue(std::move(data), frameCount);
+}
+
+bool FrameBatcher::queue(std::string data, size_t frameCount) {
+    size_t size = data.size();
+    status = handler.queueBytes(std::move(data), mode);
+    // Frames count as sent only once their chunk is queued, not when it is dropped or refused
+    if (status == SendStatus::QUEUED) {
+        for (ClientStats::Counter counter : pendingCounters) ClientStats::add(counter);
+    }
+    pendingCounters.clear();
+    if (status == SendStatus::DROPPED) {
+        framesDropped += frameCount;
+        return true;
+    }
+    if (status != SendStatus::QUEUED) return false;
+    framesSent += frameCount;
+    bytesSent += size;
+    chunks++;
+    return true;
+}
+
+SendStatus FrameBatcher::getStatus() const {
+    return status;
+}
+
+size_t FrameBatcher::getFramesSent() const {
+    return framesSent;
+}
+
+void FrameBatcher::printStats(std::ostream& out) const {
+    double seconds = 0;
+    if (startTime != std::chrono::steady_clock::time_point())
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    if (seconds <= 0) seconds = 1e-9;
+    out << "Published " << framesSent << " frames (" << bytesSent << " bytes) in " << chunks
+        << " chunks, " << seconds * 1000 << " ms: " << static_cast<long long>(framesSent / seconds)
+        << " frames/sec, " << static_cast<long long>(bytesSent / seconds) << " bytes/sec";
+    if (framesDropped > 0) out << ", " << framesDropped << " frames dropped";
+    out << std::endl;
+
+    SendQueueStats queueStats = handler.getSendQueueStats();
+    out << "Send queue: " << queueStats.queuedBytes << " bytes in " << queueStats.queuedChunks
+        << " chunks waiting (peak " << queueStats.peakBytes << ", watermarks " << queueStats.highWatermark
+        << "/" << queueStats.lowWatermark << "), " << queueStats.writes << " writes, " << queueStats.blocked
+        << " blocked, " << queueStats.dropped << " dropped, " << queueStats.wouldBlock << " would block" << std::endl;
+}
@@ -0,0 +1,50 @@
+#include "../include/LineReader.h"
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+
+LineReader::LineReader(int fd) : fd(fd), buffer(), endOfInput(false)
+{
+}
+
+LineReader::Result LineReader::readLine(std::string& line, int wakeFd) {
+    while (true) {
+        size_t newline = buffer.find('\n');
+        if (newline != std::string::npos) {
+            line.assign(buffer, 0, newline);
+            buffer.erase(0, newline + 1);
+            return LINE;
+        }
+        if (endOfInput) {
+            // A last line without a '\n' still counts, like std::getline
+            if (buffer.empty()) return END_OF_INPUT;
+            line.swap(buffer);
+            buffer.clear();
+            return LINE;
+        }
+
+        struct pollfd fds[2];
+        fds[0].fd = fd;
+        fds[0].events = POLLIN;
+        fds[1].fd = wakeFd;
+        fds[1].events = POLLIN;
+        if (::poll(fds, wakeFd >= 0 ? 2 : 1, -1) < 0) {
+            if (errno == EINTR) continue;
+            return END_OF_INPUT;
+        }
+        if (wakeFd >= 0 && (fds[1].revents & POLLIN)) return WOKEN;
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            char chunk[4096];
+            ssize_t bytes = ::read(fd, chunk, sizeof(chunk));
+            if (bytes < 0 && errno == EINTR) continue;
+            if (bytes <= 0) endOfInput = true;
+            else buffer.append(chunk, bytes);
+        }
+    }
+}
+
+std::string LineReader::takePending() {
+    std::string pending;
+    pending.swap(buffer);
+    return pending;
+}
@@ -0,0 +1,283 @@
+#include "../include/MockBroker.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+#include <sys/socket.h>
+
+MockBroker::MockBroker() :
+    io(),
+    acceptor(io),
+    acceptThread(),
+    running(false),
+    mutex(),
+    sessions(),
+    subscribers(),
+    nextMessageId(0),
+    recordMutex(),
+    recording(),
+    replayData(),
+    replayFrames(),
+    replayRate(0)
+{
+}
+
+MockBroker::~MockBroker()
+{
+    stop();
+}
+
+bool MockBroker::start(unsigned short port)
+{
+    boost::system::error_code error;
+    tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), port);
+    acceptor.open(endpoint.protocol(), error);
+    if (!error) acceptor.set_option(tcp::acceptor::reuse_address(true), error);
+    if (!error) acceptor.bind(endpoint, error);
+    if (!error) acceptor.listen(boost::asio::socket_base::max_listen_connections, error);
+    if (error) {
+        acceptor.close(error);
+        return false;
+    }
+    running = true;
+    acceptThread = std::thread(&MockBroker::acceptLoop, this);
+    return true;
+}
+
+unsigned short MockBroker::getPort() const
+{
+    boost::system::error_code error;
+    return acceptor.local_endpoint(error).port();
+}
+
+void MockBroker::stop()
+{
+    if (!running.exchange(false)) return;
+    // Shutting the listening socket down is what makes a blocked accept() return
+    ::shutdown(acceptor.native_handle(), SHUT_RDWR);
+    if (acceptThread.joinable()) acceptThread.join();
+    boost::system::error_code error;
+    acceptor.close(error);
+
+    std::vector<std::shared_ptr<Session>> all;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        all = sessions;
+    }
+    for (auto &session : all) session->socket.shutdown(tcp::socket::shutdown_both, error);
+    for (auto &session : all) {
+        if (session->thread.joinable()) session->thread.join();
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    sessions.clear();
+    subscribers.clear();
+}
+
+bool MockBroker::record(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(recordMutex);
+    recording.open(path, std::ios::binary | std::ios::trunc);
+    return recording.is_open();
+}
+
+bool MockBroker::loadReplay(const std::string &path, double framesPerSecond)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    std::stringstream data;
+    data << in.rdbuf();
+    replayData = data.str();
+    replayFrames.clear();
+    size_t begin = 0;
+    size_t end;
+    while ((end = replayData.find('\0', begin)) != std::string::npos) {
+        replayFrames.push_back(begin);
+        begin = end + 1;
+    }
+    // Anything after the last null character is not a whole frame
+    replayData.resize(begin);
+    replayRate = framesPerSecond;
+    return true;
+}
+
+size_t MockBroker::getReplayFrames() const
+{
+    return replayFrames.size();
+}
+
+void MockBroker::acceptLoop()
+{
+    while (running) {
+        std::shared_ptr<Session> session = std::make_shared<Session>(io);
+        boost::system::error_code error;
+        acceptor.accept(session->socket, error);
+        if (error) {
+            if (!running) return;
+            continue;
+        }
+        session->socket.set_option(tcp::no_delay(true), error);
+        std::lock_guard<std::mutex> lock(mutex);
+        sessions.push_back(session);
+        session->thread = std::thread(&MockBroker::serve, this, session);
+    }
+}
+
+void MockBroker::serve(std::shared_ptr<Session> session)
+{
+    std::vector<char> buffer(64 * 1024);
+    size_t head = 0;
+    size_t tail = 0;
+    bool connected = true;
+    while (connected) {
+        // Keep the pending bytes contiguous: move them to the front, or grow if they fill the buffer
+        if (tail == buffer.size()) {
+            if (head > 0) {
+                std::memmove(&buffer[0], &buffer[head], tail - head);
+                tail -= head;
+                head = 0;
+            } else {
+                buffer.resize(buffer.size() * 2);
+            }
+        }
+        boost::system::error_code error;
+        size_t bytes = session->socket.read_some(boost::asio::buffer(&buffer[tail], buffer.size() - tail), error);
+        if (error) break;
+        size_t scanned = tail;
+        tail += bytes;
+
+        const char *end;
+        while (connected && (end = static_cast<const char *>(std::memchr(&buffer[scanned], '\0', tail - scanned))) != nullptr) {
+            const char *data = &buffer[head];
+            size_t length = end - data;
+            head += length + 1;
+            scanned = head;
+            // Frames may be preceded by newlines (heart-beats), and some clients send stray terminators
+            while (length > 0 && (*data == '\n' || *data == '\r')) {
+                data++;
+                length--;
+            }
+            if (length > 0) connected = handleFrame(session, FrameView::parse(data, length));
+        }
+        if (head == tail) head = tail = 0;
+    }
+
+    // The client is gone: drop its subscriptions
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = subscribers.begin(); it != subscribers.end();) {
+        if (it->second.first == session) it = subscribers.erase(it);
+        else ++it;
+    }
+    boost::system::error_code error;
+    session->socket.shutdown(tcp::socket::shutdown_both, error);
+}
+
+bool MockBroker::handleFrame(const std::shared_ptr<Session> &session, const FrameView &frame)
+{
+    TextSpan value;
+    if (frame.command.equals("CONNECT") || frame.command.equals("STOMP")) {
+        if (frame.header("login", value)) session->user = value.str();
+        return send(*session, "CONNECTED\nversion:1.2\n\n");
+    }
+    if (frame.command.equals("SUBSCRIBE")) {
+        TextSpan id;
+        if (frame.header(StompHeaders::DESTINATION, value) && frame.header("id", id)) {
+            std::lock_guard<std::mutex> lock(mutex);
+            subscribers.emplace(value.str(), Subscriber(session, id.str()));
+        }
+        if (!session->subscribed) {
+            session->subscribed = true;
+            // The receipt goes first, so the client knows it joined before the recording starts
+            if (frame.header("receipt", value) && !send(*session, "RECEIPT\nreceipt-id:" + value.str() + "\n\n")) return false;
+            return replayFrames.empty() || replay(*session);
+        }
+    } else if (frame.command.equals("UNSUBSCRIBE")) {
+        if (frame.header("id", value)) unsubscribe(session, value.str());
+    } else if (frame.command.equals("SEND")) {
+        if (frame.header(StompHeaders::DESTINATION, value)) publish(value.str(), *session, frame.body);
+    } else if (frame.command.equals("DISCONNECT")) {
+        if (frame.header("receipt", value)) send(*session, "RECEIPT\nreceipt-id:" + value.str() + "\n\n");
+        return false;
+    } else {
+        send(*session, "ERROR\nmessage:unsupported command " + frame.command.str() + "\n\n");
+        return false;
+    }
+    if (frame.header("receipt", value)) return send(*session, "RECEIPT\nreceipt-id:" + value.str() + "\n\n");
+    return true;
+}
+
+void MockBroker::publish(const std::string &destination, const Session &from, const TextSpan &body)
+{
+    std::vector<Subscriber> targets;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto range = subscribers.equal_range(destination);
+        for (auto it = range.first; it != range.second; ++it) targets.push_back(it->second);
+    }
+    if (targets.empty()) return;
+
+    // Everything after the subscription header is the same for every subscriber
+    std::string rest = "\ndestination:" + destination + "\nmessage-id:" + std::to_string(nextMessageId++) +
+                       "\nuser:" + from.user + "\n\n";
+    rest.append(body.data, body.size);
+    for (size_t i = 0; i < targets.size(); i++) {
+        std::string message = "MESSAGE\nsubscription:" + targets[i].second + rest;
+        if (i == 0) {
+            std::lock_guard<std::mutex> lock(recordMutex);
+            if (recording.is_open()) recording.write(message.c_str(), message.size() + 1);
+        }
+        send(*targets[i].first, message);
+    }
+}
+
+bool MockBroker::replay(Session &session)
+{
+    if (replayRate <= 0) {
+        // As fast as possible: the recording goes out in large writes, regardless of frame boundaries
+        static const size_t CHUNK = 256 * 1024;
+        for (size_t offset = 0; offset < replayData.size(); offset += CHUNK) {
+            if (!running || !sendRaw(session, replayData.data() + offset, std::min(CHUNK, replayData.size() - offset)))
+                return false;
+        }
+        return true;
+    }
+
+    // At a fixed rate: one frame at a time, each on its own schedule (a late frame doesn't shift the next ones)
+    typedef std::chrono::steady_clock Clock;
+    auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / replayRate));
+    Clock::time_point next = Clock::now();
+    for (size_t i = 0; i < replayFrames.size(); i++) {
+        std::this_thread::sleep_until(next);
+        next += period;
+        size_t end = i + 1 < replayFrames.size() ? replayFrames[i + 1] : replayData.size();
+        if (!running || !sendRaw(session, replayData.data() + replayFrames[i], end - replayFrames[i])) return false;
+    }
+    return true;
+}
+
+void MockBroker::unsubscribe(const std::shared_ptr<Session> &session, const std::string &id)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = subscribers.begin(); it != subscribers.end();) {
+        if (it->second.first == session && it->second.second == id) it = subscribers.erase(it);
+        else ++it;
+    }
+}
+
+bool MockBroker::sendRaw(Session &session, const char *data, size_t length)
+{
+    std::lock_guard<std::mutex> lock(session.writeMutex);
+    boost::system::error_code error;
+    boost::asio::write(session.socket, boost::asio::buffer(data, length), error);
+    return !error;
+}
+
+bool MockBroker::send(Session &session, const std::string &frame)
+{
+    std::vector<boost::asio::const_buffer> buffers;
+    buffers.push_back(boost::asio::buffer(frame));
+    buffers.push_back(boost::asio::buffer("", 1));
+    std::lock_guard<std::mutex> lock(session.writeMutex);
+    boost::system::error_code error;
+    boost::asio::write(session.socket, buffers, error);
+    return !error;
+}
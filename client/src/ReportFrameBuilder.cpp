@@ -0,0 +1,179 @@
+#include "../include/ReportFrameBuilder.h"
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+
+ReportFrameBuilder::ReportFrameBuilder(const std::string &userName) :
+    userName(userName),
+    teamA(),
+    teamB(),
+    prefix(),
+    frame()
+{
+}
+
+void ReportFrameBuilder::buildPrefix(const Event &event)
+{
+    teamA = event.get_team_a_name();
+    teamB = event.get_team_b_name();
+    prefix.clear();
+    prefix += "SEND\ndestination:/";
+    prefix += teamA;
+    prefix += '_';
+    prefix += teamB;
+    prefix += "\n\nuser: ";
+    prefix += userName;
+    prefix += "\nteam a: ";
+    prefix += teamA;
+    prefix += "\nteam b: ";
+    prefix += teamB;
+    prefix += '\n';
+}
+
+// "    key: value\n" for every update
+size_t ReportFrameBuilder::updatesSize(const EventUpdates &updates)
+{
+    size_t size = 0;
+    for (auto const &update : updates) size += update.first.size() + update.second.size() + 7;
+    return size;
+}
+
+void ReportFrameBuilder::appendUpdates(const EventUpdates &updates)
+{
+    for (auto const &update : updates) {
+        frame.append("    ", 4);
+        frame += update.first;
+        frame.append(": ", 2);
+        frame += update.second;
+        frame += '\n';
+    }
+}
+
+const std::string &ReportFrameBuilder::build(const Event &event)
+{
+    // Every event of a file is normally about the same game, so the prefix is almost always reused
+    if (teamA != event.get_team_a_name() || teamB != event.get_team_b_name()) buildPrefix(event);
+
+    char time[24];
+    int timeLength = std::snprintf(time, sizeof(time), "%d", event.get_time());
+
+    static const char nameTitle[] = "event name: ";
+    static const char timeTitle[] = "time: ";
+    static const char gameTitle[] = "general game updates:\n";
+    static const char teamATitle[] = "team a updates:\n";
+    static const char teamBTitle[] = "team b updates:\n";
+    static const char descriptionTitle[] = "description:\n";
+
+    frame.clear();
+    // The titles without their null terminators, plus the line ends after the name, the time and the description
+    size_t titles = sizeof(nameTitle) + sizeof(timeTitle) + sizeof(gameTitle) + sizeof(teamATitle) +
+                    sizeof(teamBTitle) + sizeof(descriptionTitle) - 6 + 3;
+    frame.reserve(prefix.size() + titles + event.get_name().size() + timeLength +
+                  updatesSize(event.get_game_updates()) + updatesSize(event.get_team_a_updates()) +
+                  updatesSize(event.get_team_b_updates()) + event.get_discription().size());
+
+    frame += prefix;
+    frame.append(nameTitle, sizeof(nameTitle) - 1);
+    frame += event.get_name();
+    frame += '\n';
+    frame.append(timeTitle, sizeof(timeTitle) - 1);
+    frame.append(time, timeLength);
+    frame += '\n';
+    frame.append(gameTitle, sizeof(gameTitle) - 1);
+    appendUpdates(event.get_game_updates());
+    frame.append(teamATitle, sizeof(teamATitle) - 1);
+    appendUpdates(event.get_team_a_updates());
+    frame.append(teamBTitle, sizeof(teamBTitle) - 1);
+    appendUpdates(event.get_team_b_updates());
+    frame.append(descriptionTitle, sizeof(descriptionTitle) - 1);
+    frame += event.get_discription();
+    frame += '\n';
+    return frame;
+}
+
+ParallelReportBuilder::ParallelReportBuilder(const std::string &userName, size_t threads, size_t eventsPerThread) :
+    threads(threads > 0 ? threads : 1),
+    batchSize(this->threads * eventsPerThread),
+    batch(),
+    builders(),
+    frames(),
+    mutex(),
+    batchReady(),
+    sliceDone(),
+    generation(0),
+    pending(0),
+    sliceSize(0),
+    stopping(false),
+    workers()
+{
+    batch.reserve(batchSize);
+    for (size_t i = 0; i < this->threads; i++) builders.emplace_back(new ReportFrameBuilder(userName));
+    for (size_t t = 1; t < this->threads; t++) workers.emplace_back(&ParallelReportBuilder::work, this, t);
+}
+
+ParallelReportBuilder::~ParallelReportBuilder()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    batchReady.notify_all();
+    for (std::thread &worker : workers) worker.join();
+}
+
+bool ParallelReportBuilder::add(Event &&event, const Sink &sink)
+{
+    batch.push_back(std::move(event));
+    if (batch.size() >= batchSize) return flush(sink);
+    return true;
+}
+
+void ParallelReportBuilder::buildSlice(size_t slice)
+{
+    size_t begin = std::min(slice * sliceSize, batch.size());
+    size_t end = std::min(begin + sliceSize, batch.size());
+    for (size_t i = begin; i < end; i++) frames[i].assign(builders[slice]->build(batch[i]));
+}
+
+void ParallelReportBuilder::work(size_t slice)
+{
+    unsigned long long done = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        batchReady.wait(lock, [this, done] { return stopping || generation != done; });
+        if (stopping) return;
+        done = generation;
+        // The batch and the frames aren't touched by anyone else until every slice is done
+        lock.unlock();
+        buildSlice(slice);
+        lock.lock();
+        if (--pending == 0) sliceDone.notify_one();
+    }
+}
+
+bool ParallelReportBuilder::flush(const Sink &sink)
+{
+    if (batch.empty()) return true;
+    if (frames.size() < batch.size()) frames.resize(batch.size());
+
+    // Contiguous slices, the calling thread takes the first one
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        sliceSize = (batch.size() + threads - 1) / threads;
+        pending = workers.size();
+        generation++;
+    }
+    batchReady.notify_all();
+    buildSlice(0);
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        sliceDone.wait(lock, [this] { return pending == 0; });
+    }
+
+    size_t count = batch.size();
+    batch.clear();
+    for (size_t i = 0; i < count; i++) {
+        if (!sink(frames[i])) return false;
+    }
+    return true;
+}
@@ -0,0 +1,46 @@
+#include "../include/SessionState.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+SessionState::SessionState() : running(false), wakePipe{-1, -1}
+{
+    if (::pipe(wakePipe) == 0) {
+        ::fcntl(wakePipe[0], F_SETFL, O_NONBLOCK);
+        ::fcntl(wakePipe[1], F_SETFL, O_NONBLOCK);
+    }
+}
+
+SessionState::~SessionState()
+{
+    if (wakePipe[0] >= 0) ::close(wakePipe[0]);
+    if (wakePipe[1] >= 0) ::close(wakePipe[1]);
+}
+
+void SessionState::start()
+{
+    // Forget the wake-ups of an earlier session
+    char drained[64];
+    while (wakePipe[0] >= 0 && ::read(wakePipe[0], drained, sizeof(drained)) > 0) {
+    }
+    running = true;
+}
+
+void SessionState::stop()
+{
+    running = false;
+    // The byte is never read, so the pipe stays readable; a full pipe (EAGAIN) is just as good
+    char wake = 1;
+    if (wakePipe[1] >= 0 && ::write(wakePipe[1], &wake, 1) < 0) {
+        // nothing to do, the pipe is already readable
+    }
+}
+
+bool SessionState::isRunning() const
+{
+    return running;
+}
+
+int SessionState::wakeFd() const
+{
+    return wakePipe[0];
+}
@@ -0,0 +1,288 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <atomic>
+#include <functional>
+#include <new>
+#include <memory>
+#include "../include/event.h"
+#include "../include/json.hpp"
+#include "../include/StompProtocol.h"
+#include "../include/StompFrame.h"
+#include "../include/ReportFrameBuilder.h"
+#include "../include/SessionState.h"
+#include "../include/ClientOptions.h"
+
+// Benchmarks for the client hot paths.
+// Usage: StompBenchmark [scale ...]
+// Every scale runs on two files (written once to bin/):
+//   bench_events_<scale>.json    - data/events1.json with its events repeated scale times
+//   bench_synthetic_<scale>.json - scale * 8 generated events with many updates, long descriptions
+//                                  and times out of order
+// Every result is one line of key=value pairs:
+//   bench=<case> data=<file kind> scale=<n> ops=<n> bytes=<n> ns/op=<n> allocs/op=<n> ops/s=<n> MB/s=<n>
+
+using json = nlohmann::json;
+
+static const char *SAMPLE_EVENTS = "data/events1.json";
+static const int DEFAULT_SCALES[] = {100, 1000};
+static const int ITERATIONS = 3;
+static const char *GAME = "Germany_Japan";
+static const char *USER = "bench";
+static const char *SUMMARY_FILE = "bin/bench_summary.txt";
+
+// Writes (or reuses) the scaled up copy of the sample events file and returns its path
+static std::string scaledEventsFile(int scale)
+{
+    std::string path = "bin/bench_events_" + std::to_string(scale) + ".json";
+    if (std::ifstream(path).good())
+        return path;
+
+    std::ifstream sample(SAMPLE_EVENTS);
+    json data = json::parse(sample);
+    json events = json::array();
+    for (int i = 0; i < scale; i++) {
+        for (auto &event : data["events"])
+            events.push_back(event);
+    }
+    data["events"] = events;
+    std::ofstream out(path);
+    out << data.dump(4);
+    return path;
+}
+
+// Writes (or reuses) a generated events file with heavier events than the sample:
+// 16 general and 8 + 8 team updates, a 1KB description and a time that jumps back and forth
+static std::string syntheticEventsFile(int scale)
+{
+    std::string path = "bin/bench_synthetic_" + std::to_string(scale) + ".json";
+    if (std::ifstream(path).good())
+        return path;
+
+    json data;
+    data["team a"] = "Germany";
+    data["team b"] = "Japan";
+    json events = json::array();
+    unsigned int seed = 12345;
+    for (int i = 0; i < scale * 8; i++) {
+        seed = seed * 1103515245 + 12345;
+        json event;
+        event["event name"] = "event " + std::to_string(seed % 97);
+        event["time"] = static_cast<int>(seed % 5400);
+        json general, teamA, teamB;
+        for (int u = 0; u < 16; u++)
+            general["stat " + std::to_string(u)] = std::to_string((seed >> u) % 100);
+        for (int u = 0; u < 8; u++) {
+            teamA["team stat " + std::to_string(u)] = std::to_string((seed >> u) % 10);
+            teamB["team stat " + std::to_string(u)] = std::to_string((seed >> (u + 8)) % 10);
+        }
+        event["general game updates"] = general;
+        event["team a updates"] = teamA;
+        event["team b updates"] = teamB;
+        event["description"] = std::string(1024, static_cast<char>('a' + i % 26));
+        events.push_back(event);
+    }
+    data["events"] = events;
+    std::ofstream out(path);
+    out << data.dump(4);
+    return path;
+}
+
+static long long fileSize(const std::string &path)
+{
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    return static_cast<long long>(f.tellg());
+}
+
+// Counts every heap allocation of the process, to report allocations per operation
+static std::atomic<long long> allocations(0);
+
+void *operator new(std::size_t size)
+{
+    allocations++;
+    void *memory = std::malloc(size == 0 ? 1 : size);
+    if (memory == nullptr)
+        throw std::bad_alloc();
+    return memory;
+}
+
+// Optimised builds inline these and then take the free() for a mismatch with operator new
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void *memory) noexcept
+{
+    std::free(memory);
+}
+#pragma GCC diagnostic pop
+
+// What one run of a case went through
+struct Work
+{
+    long long ops;
+    long long bytes;
+};
+
+// Runs a case ITERATIONS times and prints the fastest run.
+// setup runs before every run and isn't measured; run returns the operations and bytes it went through.
+static void bench(const std::string &name, const std::string &data, int scale,
+                  const std::function<void()> &setup, const std::function<Work()> &run)
+{
+    double best = 0;
+    Work work{0, 0};
+    long long allocated = 0;
+    for (int i = 0; i < ITERATIONS; i++) {
+        setup();
+        long long allocationsBefore = allocations;
+        auto start = std::chrono::steady_clock::now();
+        work = run();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        allocated = allocations - allocationsBefore;
+        if (i == 0 || seconds < best) best = seconds;
+    }
+    double ops = work.ops > 0 ? static_cast<double>(work.ops) : 1;
+    std::cout << "bench=" << name << " data=" << data << " scale=" << scale << " ops=" << work.ops
+              << " bytes=" << work.bytes << " ns/op=" << static_cast<long long>(best * 1e9 / ops)
+              << " allocs/op=" << static_cast<double>(allocated) / ops
+              << " ops/s=" << static_cast<long long>(work.ops / best)
+              << " MB/s=" << work.bytes / best / 1e6 << std::endl;
+}
+
+static void noSetup()
+{
+}
+
+// The bodies of the SEND frames report builds for a file, which are the bodies of the MESSAGE frames it causes
+static std::vector<std::string> reportBodies(const std::string &path)
+{
+    std::vector<std::string> bodies;
+    ReportFrameBuilder builder(USER);
+    parseEventsFile(path, [&bodies, &builder](const Event &event) {
+        const std::string &frame = builder.build(event);
+        bodies.push_back(frame.substr(frame.find("\n\n") + 2));
+        return true;
+    });
+    return bodies;
+}
+
+// The MESSAGE frames a subscriber to the game receives for the bodies (without their null terminators)
+static std::vector<std::string> messageFrames(const std::vector<std::string> &bodies)
+{
+    std::vector<std::string> frames;
+    frames.reserve(bodies.size());
+    for (size_t i = 0; i < bodies.size(); i++) {
+        frames.push_back("MESSAGE\nsubscription:0\nmessage-id:" + std::to_string(i) + "\ndestination:/" + GAME +
+                         "\n\n" + bodies[i]);
+    }
+    return frames;
+}
+
+static void benchFile(const std::string &path, const std::string &data, int scale)
+{
+    long long bytes = fileSize(path);
+
+    // Event file parsing, streamed and collected
+    for (EventFileInput input : {EventFileInput::STREAM, EventFileInput::MMAP}) {
+        bench(input == EventFileInput::MMAP ? "parse_events_file_mmap" : "parse_events_file", data, scale, noSetup,
+              [&path, input, bytes]() {
+            long long events = 0;
+            parseEventsFile(path, [&events](const Event &) {
+                events++;
+                return true;
+            }, input);
+            return Work{events, bytes};
+        });
+    }
+    bench("collect_events", data, scale, noSetup, [&path, bytes]() {
+        names_and_events parsed = parseEventsFile(path);
+        return Work{static_cast<long long>(parsed.events.size()), bytes};
+    });
+
+    // Event(const std::string&) on the bodies of received frames
+    std::vector<std::string> bodies = reportBodies(path);
+    long long bodyBytes = 0;
+    for (const std::string &body : bodies) bodyBytes += body.size();
+    bench("event_parse", data, scale, noSetup, [&bodies, bodyBytes]() {
+        long long checksum = 0;
+        for (const std::string &body : bodies) checksum += Event(body).get_time();
+        if (checksum == -1) std::cout << checksum;
+        return Work{static_cast<long long>(bodies.size()), bodyBytes};
+    });
+
+    // report frame building alone, on events parsed beforehand
+    names_and_events parsed = parseEventsFile(path);
+    bench("report_build", data, scale, noSetup, [&parsed]() {
+        ReportFrameBuilder builder(USER);
+        long long built = 0;
+        for (const Event &event : parsed.events) built += builder.build(event).size();
+        return Work{static_cast<long long>(parsed.events.size()), built};
+    });
+
+    // The whole report command (parse, build, hand to the sink), serial and on 4 threads
+    SessionState session;
+    ClientOptions options;
+    options.quiet = true;
+    for (size_t threads : {static_cast<size_t>(1), static_cast<size_t>(4)}) {
+        bench(threads == 1 ? "report" : "report_threads4", data, scale, noSetup, [&path, &session, &options, threads]() {
+            options.reportThreads = threads;
+            StompProtocol protocol(session, options);
+            Work work{0, 0};
+            protocol.processInput("report " + path, [&work](const std::string &frame) {
+                work.ops++;
+                work.bytes += frame.size();
+                return true;
+            });
+            return work;
+        });
+    }
+    options.reportThreads = 1;
+
+    // Received MESSAGE frames: frame parsing, event parsing and storing (quiet, nothing is printed)
+    std::vector<std::string> frames = messageFrames(bodies);
+    long long frameBytes = 0;
+    for (const std::string &frame : frames) frameBytes += frame.size();
+    bench("process_server_frame", data, scale, noSetup, [&frames, frameBytes, &session, &options]() {
+        StompProtocol protocol(session, options);
+        for (const std::string &frame : frames) protocol.processServerFrame(FrameView::parse(frame.data(), frame.size()));
+        return Work{static_cast<long long>(frames.size()), frameBytes};
+    });
+
+    // summary of all those reports. It is written to /dev/null, so only the generation is measured;
+    // one summary goes to bin/bench_summary.txt first to know how much text that is.
+    std::unique_ptr<StompProtocol> loaded;
+    auto load = [&loaded, &frames, &session, &options]() {
+        loaded.reset(new StompProtocol(session, options));
+        for (const std::string &frame : frames) loaded->processServerFrame(FrameView::parse(frame.data(), frame.size()));
+    };
+    auto summarize = [&loaded](const std::string &file) {
+        // "Summary saved to" would end up between the results
+        std::ofstream discard;
+        std::streambuf *console = std::cout.rdbuf(discard.rdbuf());
+        loaded->processInput(std::string("summary ") + GAME + " " + USER + " " + file, [](const std::string &) { return true; });
+        std::cout.rdbuf(console);
+    };
+    load();
+    summarize(SUMMARY_FILE);
+    long long summaryBytes = fileSize(SUMMARY_FILE);
+    bench("summary", data, scale, load, [&summarize, &frames, summaryBytes]() {
+        summarize("/dev/null");
+        return Work{static_cast<long long>(frames.size()), summaryBytes};
+    });
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<int> scales;
+    for (int i = 1; i < argc; i++)
+        scales.push_back(std::atoi(argv[i]));
+    if (scales.empty())
+        scales.assign(std::begin(DEFAULT_SCALES), std::end(DEFAULT_SCALES));
+
+    for (int scale : scales) {
+        benchFile(scaledEventsFile(scale), "events1", scale);
+        benchFile(syntheticEventsFile(scale), "synthetic", scale);
+    }
+    return 0;
+}
@@ -3,18 +3,94 @@
 #include <vector>
 #include <sstream>
 #include <thread>
+#include <unistd.h>
 #include "../include/ConnectionHandler.h"
 #include "../include/StompProtocol.h"
+#include "../include/ClientOptions.h"
+#include "../include/FrameBatcher.h"
+#include "../include/SessionState.h"
+#include "../include/LineReader.h"
+#include "../include/AsyncClient.h"
+
+// Runs a logged in session with two threads: the socket thread reads frames from the server
+// while this thread reads the console and sends frames
+static void runThreaded(ConnectionHandler* handler, StompProtocol& protocol, SessionState& session,
+                        ClientOptions& options, LineReader& console) {
+    //Socket Thread- listens for frames from the server 
+    std::thread socketThread([handler, &protocol, &session]() {
+        while (session.isRunning()) {
+            // The frame is parsed in place, it is valid until the next read from the handler
+            const char* frame;
+            size_t frameLength;
+            if (!handler->getFrameSpan(frame, frameLength, '\0')) {
+                // A read that fails after the session ended is our own shutdown, not the server's
+                protocol.flushOutput();
+                if (session.isRunning()) std::cout << "Disconnected from server" << std::endl;
+                session.stop();
+                break;
+            }
+            protocol.processServerFrame(FrameView::parse(frame, frameLength)); 
+        }
+    });
+
+    // Frames are written by the handler's writer thread, so a slow server doesn't hold up the console
+    handler->setSendQueueLimits(options.queueHigh, options.queueLow);
+
+    // Reads user input and sends frames to the server 
+    // Logout, a server error or a lost connection stop the session and wake this loop right away
+    while (session.isRunning()) {
+        std::string line;
+        // At the end of the input the socket thread still runs until the logout receipt (or a disconnect)
+        if (console.readLine(line, session.wakeFd()) != LineReader::LINE) break;
+
+        std::stringstream ss(line);
+        std::string command;
+        ss >> command;
+        if (command == "set") {
+            options.setFromConsole(ss, std::cout);
+            handler->setSendQueueLimits(options.queueHigh, options.queueLow);
+            continue;
+        }
+
+        // Frames are coalesced into chunks of up to batchFrames frames / batchBytes bytes.
+        // Only report may drop or give up on frames while the send queue is full, other commands wait for room.
+        OverflowMode overflow = command == "report" ? options.reportOverflow : OverflowMode::BLOCK;
+        FrameBatcher batcher(*handler, options.batchFrames, options.batchBytes, '\0', overflow);
+        // frames are published as they are built (a report starts sending while its file is parsed)
+        bool sent = protocol.processInput(line, [&batcher](const std::string& frame) {
+            return batcher.add(frame);
+        });
+        if (sent) sent = batcher.flush();
+        if (!sent && batcher.getStatus() == SendStatus::WOULD_BLOCK) {
+            std::cout << "Send queue is full, report stopped after " << batcher.getFramesSent() << " events" << std::endl;
+        } else if (!sent) {
+            // The connection is broken: make the socket thread's blocked read return too
+            session.stop();
+            handler->shutdown();
+        }
+        if (command == "report") {
+            batcher.printStats(std::cout);
+        }
+    }
+    //Waiting for the socket thread to finish before exiting 
+    if (socketThread.joinable()) {
+        socketThread.join();
+    }
+}
 
 int main(int argc, char *argv[]) {
     // TODO: implement the STOMP client
+    bool asyncMode = argc > 1 && std::string(argv[1]) == "--async";
     ConnectionHandler* handler = nullptr;
-    bool loggedIn = false;
-    StompProtocol protocol(loggedIn); 
+    SessionState session; // logged in until logout, a server error or a lost connection
+    ClientOptions options;
+    StompProtocol protocol(session, options); 
+    // Reads the console; unlike std::getline it can be woken up when the session ends
+    LineReader console(STDIN_FILENO);
     
-    while (!loggedIn) {
+    while (!session.isRunning()) {
         std::string line; //saves what the client entered
-        if (!std::getline(std::cin, line)) break; //waits for the client to type and press enter, insert each line typed to "line"
+        if (console.readLine(line, -1) != LineReader::LINE) break; //waits for the client to type and press enter, insert each line typed to "line"
         std::stringstream ss(line); //makes a stream from string
         
         //takes the first word
@@ -58,7 +134,7 @@ int main(int argc, char *argv[]) {
 
             if (handler->sendFrameAscii(connectFrame, '\0')) {
                 // Connection sent successfully
-                loggedIn = true; 
+                session.start(); 
             }
             else {
                 std::cout << "Failed to send CONNECT frame" << std::endl;
@@ -66,47 +142,22 @@ int main(int argc, char *argv[]) {
                 handler = nullptr;
             }
         }
+        else if (command == "set") {
+            options.setFromConsole(ss, std::cout);
+        }
         else {
             std::cout << "You must login first" << std::endl;
         }
     }
 
-    if (loggedIn && handler != nullptr) { //if logged  and connected succesfully
-        //Socket Thread- listens for frames from the server 
-        std::thread socketThread([handler, &protocol, &loggedIn]() {
-            while (loggedIn) {
-                std::string frame;
-                if (!handler->getFrameAscii(frame, '\0')) {
-                    std::cout << "Disconnected from server" << std::endl;
-                    loggedIn = false;
-                    break;
-                }
-                protocol.processServerFrame(frame); 
-            }
-        });
-
-        // Reads user input and sends frames to the server 
-        while (loggedIn) {
-            std::string line;
-            if (!std::getline(std::cin, line)) break;
-
-            // gets all the messages (for the report)
-            std::vector<std::string> framesToSend = protocol.processInput(line);
-            // sending all frames
-            for (const std::string& frame : framesToSend) {
-                if (!frame.empty()) {
-                    if (!handler->sendFrameAscii(frame, '\0')) {
-                        loggedIn = false;
-                        break;
-                    }
-                }
-            }
-
-            if (!loggedIn) break; 
-        }
-        //Waiting for the socket thread to finish before exiting 
-        if (socketThread.joinable()) {
-            socketThread.join();
+    if (session.isRunning() && handler != nullptr) { //if logged  and connected succesfully
+        // --async runs the whole session on one thread; it needs a console that can be polled (not a file)
+        AsyncClient asyncClient(*handler, protocol, session, options);
+        if (asyncMode && asyncClient.openConsole()) {
+            asyncClient.run(console.takePending());
+        } else {
+            if (asyncMode) std::cout << "Async mode needs stdin to be a terminal or a pipe, using threads" << std::endl;
+            runThreaded(handler, protocol, session, options, console);
         }
     }
 
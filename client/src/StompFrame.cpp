@@ -0,0 +1,177 @@
+#include "../include/StompFrame.h"
+#include <cstring>
+
+static bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Returns the end of the line starting at begin (the '\n' or end itself)
+static const char *lineEnd(const char *begin, const char *end)
+{
+    const char *newline = static_cast<const char *>(std::memchr(begin, '\n', end - begin));
+    return newline == nullptr ? end : newline;
+}
+
+TextSpan::TextSpan() : data(nullptr), size(0)
+{
+}
+
+TextSpan::TextSpan(const char *data, size_t size) : data(data), size(size)
+{
+}
+
+const char *TextSpan::begin() const
+{
+    return data;
+}
+
+const char *TextSpan::end() const
+{
+    return data + size;
+}
+
+bool TextSpan::empty() const
+{
+    return size == 0;
+}
+
+bool TextSpan::equals(const char *text) const
+{
+    return std::strlen(text) == size && std::memcmp(data, text, size) == 0;
+}
+
+std::string TextSpan::str() const
+{
+    return size == 0 ? std::string() : std::string(data, size);
+}
+
+TextSpan TextSpan::trimmed() const
+{
+    const char *first = begin();
+    const char *last = end();
+    while (first < last && isSpace(*first)) first++;
+    while (last > first && isSpace(*(last - 1))) last--;
+    return TextSpan(first, last - first);
+}
+
+StompHeaders::StompHeaders() : known(), extra(), extraCount(0), overflow()
+{
+}
+
+StompHeaders::Known StompHeaders::lookup(const char *name, size_t length)
+{
+    // The length tells the well known names apart (except message-id/receipt-id), a compare confirms
+    switch (length) {
+    case 4:
+        if (std::memcmp(name, "user", 4) == 0) return USER;
+        break;
+    case 7:
+        if (std::memcmp(name, "message", 7) == 0) return MESSAGE;
+        break;
+    case 10:
+        if (name[0] == 'm' && std::memcmp(name, "message-id", 10) == 0) return MESSAGE_ID;
+        if (name[0] == 'r' && std::memcmp(name, "receipt-id", 10) == 0) return RECEIPT_ID;
+        break;
+    case 11:
+        if (std::memcmp(name, "destination", 11) == 0) return DESTINATION;
+        break;
+    case 12:
+        if (std::memcmp(name, "subscription", 12) == 0) return SUBSCRIPTION;
+        break;
+    }
+    return KNOWN_COUNT;
+}
+
+const StompHeaders::Header *StompHeaders::findExtra(const char *name, size_t length) const
+{
+    for (size_t i = 0; i < extraCount; i++) {
+        if (extra[i].name.size == length && std::memcmp(extra[i].name.data, name, length) == 0) return &extra[i];
+    }
+    for (const Header &header : overflow) {
+        if (header.name.size == length && std::memcmp(header.name.data, name, length) == 0) return &header;
+    }
+    return nullptr;
+}
+
+StompHeaders::Header *StompHeaders::findExtra(const char *name, size_t length)
+{
+    return const_cast<Header *>(static_cast<const StompHeaders *>(this)->findExtra(name, length));
+}
+
+void StompHeaders::add(TextSpan name, TextSpan value)
+{
+    Known slot = lookup(name.data, name.size);
+    if (slot != KNOWN_COUNT) {
+        known[slot] = value;
+        return;
+    }
+    Header *existing = findExtra(name.data, name.size);
+    if (existing != nullptr) {
+        existing->value = value;
+        return;
+    }
+    Header header(name, value);
+    if (extraCount < INLINE_HEADERS) extra[extraCount++] = header;
+    else overflow.push_back(header);
+}
+
+bool StompHeaders::get(Known header, TextSpan &value) const
+{
+    if (header == KNOWN_COUNT || known[header].data == nullptr) return false;
+    value = known[header];
+    return true;
+}
+
+bool StompHeaders::get(const char *name, TextSpan &value) const
+{
+    size_t length = std::strlen(name);
+    Known slot = lookup(name, length);
+    if (slot != KNOWN_COUNT) return get(slot, value);
+    const Header *header = findExtra(name, length);
+    if (header == nullptr) return false;
+    value = header->value;
+    return true;
+}
+
+FrameView::FrameView() : command(), headers(), body()
+{
+}
+
+FrameView FrameView::parse(const char *data, size_t size)
+{
+    FrameView frame;
+    const char *end = data + size;
+
+    const char *commandEnd = lineEnd(data, end);
+    frame.command = TextSpan(data, commandEnd - data);
+    if (!frame.command.empty() && *(frame.command.end() - 1) == '\r') frame.command.size--;
+
+    // Headers run until the first empty line ("\n" or "\r\n"), each one is trimmed in place
+    const char *line = commandEnd == end ? end : commandEnd + 1;
+    while (line < end) {
+        const char *next = lineEnd(line, end);
+        if (next == line || (next == line + 1 && *line == '\r')) {
+            const char *bodyBegin = next == end ? end : next + 1;
+            frame.body = TextSpan(bodyBegin, end - bodyBegin);
+            return frame;
+        }
+        const char *colon = static_cast<const char *>(std::memchr(line, ':', next - line));
+        if (colon != nullptr) {
+            frame.headers.add(TextSpan(line, colon - line).trimmed(), TextSpan(colon + 1, next - colon - 1).trimmed());
+        }
+        line = next == end ? end : next + 1;
+    }
+    frame.body = TextSpan(end, 0);
+    return frame;
+}
+
+bool FrameView::header(const char *name, TextSpan &value) const
+{
+    return headers.get(name, value);
+}
+
+bool FrameView::header(StompHeaders::Known name, TextSpan &value) const
+{
+    return headers.get(name, value);
+}
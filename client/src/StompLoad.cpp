@@ -0,0 +1,357 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include "../include/ConnectionHandler.h"
+#include "../include/StompProtocol.h"
+#include "../include/StompFrame.h"
+#include "../include/ReportFrameBuilder.h"
+#include "../include/SessionState.h"
+#include "../include/ClientOptions.h"
+#include "../include/MockBroker.h"
+#include "../include/ToolSupport.h"
+
+// Load generator: N client sessions subscribe to the same M channels and publish events at a fixed rate,
+// every subscriber measures how long each event took from publish to receive.
+// Usage: StompLoad [--host H --port P | --record F] [--sessions N] [--channels M] [--rate R] [--duration S] [--payload B]
+//   Without --port a MockBroker is started on a free loopback port. R is events per second per session,
+//   S the publishing time in seconds and B the size of each event's description.
+//   --record saves the MESSAGE frames the MockBroker delivers, to replay with StompReplay --frames.
+// The result is one line of key=value pairs (latencies in microseconds).
+// Every session keeps the reports it receives (like the client does), so memory grows with N * N * R * S.
+
+static long long nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+// Log-linear histogram: exact below 64, then 32 buckets per power of two (about 3% error)
+class LatencyHistogram
+{
+    private:
+        static const int SUB_BUCKETS = 32;
+        std::vector<unsigned long long> counts;
+        unsigned long long total;
+        unsigned long long max;
+
+        static size_t index(unsigned long long value)
+        {
+            if (value < 2 * SUB_BUCKETS) return static_cast<size_t>(value);
+            int shift = 63 - __builtin_clzll(value) - 5;
+            return 2 * SUB_BUCKETS + (shift - 1) * SUB_BUCKETS + static_cast<size_t>((value >> shift) - SUB_BUCKETS);
+        }
+
+        // The largest value that falls into a bucket
+        static unsigned long long upperBound(size_t bucket)
+        {
+            if (bucket < 2 * SUB_BUCKETS) return bucket;
+            size_t shift = (bucket - 2 * SUB_BUCKETS) / SUB_BUCKETS + 1;
+            unsigned long long sub = (bucket - 2 * SUB_BUCKETS) % SUB_BUCKETS + SUB_BUCKETS;
+            return ((sub + 1) << shift) - 1;
+        }
+
+    public:
+        LatencyHistogram() : counts(2 * SUB_BUCKETS + 64 * SUB_BUCKETS), total(0), max(0) {}
+
+        void record(unsigned long long value)
+        {
+            counts[index(value)]++;
+            total++;
+            max = std::max(max, value);
+        }
+
+        void merge(const LatencyHistogram &other)
+        {
+            for (size_t i = 0; i < counts.size(); i++) counts[i] += other.counts[i];
+            total += other.total;
+            max = std::max(max, other.max);
+        }
+
+        unsigned long long getTotal() const { return total; }
+        unsigned long long getMax() const { return max; }
+
+        // The value below which a fraction of the samples fall (rounded up to its bucket)
+        unsigned long long percentile(double fraction) const
+        {
+            if (total == 0) return 0;
+            unsigned long long rank = static_cast<unsigned long long>(fraction * total);
+            if (rank >= total) rank = total - 1;
+            unsigned long long seen = 0;
+            for (size_t i = 0; i < counts.size(); i++) {
+                seen += counts[i];
+                if (seen > rank) return std::min(upperBound(i), max);
+            }
+            return max;
+        }
+};
+
+struct LoadConfig
+{
+    std::string host;
+    unsigned short port;
+    int sessions;
+    int channels;
+    double rate;
+    double duration;
+    size_t payload;
+    std::string record;
+
+    LoadConfig() : host("127.0.0.1"), port(0), sessions(4), channels(2), rate(200), duration(5), payload(256), record() {}
+};
+
+static const char *LATENCY_KEY = "sent_ns";
+
+// One client: a ConnectionHandler and a StompProtocol like StompWCIClient's, a publisher and a receiver thread
+class LoadSession
+{
+    private:
+        const LoadConfig &config;
+        const int number;
+        const std::string user;
+        ConnectionHandler handler;
+        SessionState state;
+        ClientOptions options;
+        StompProtocol protocol;
+        std::thread receiver;
+
+        void receive()
+        {
+            const std::string marker = std::string(LATENCY_KEY) + ": ";
+            while (true) {
+                const char *data;
+                size_t length;
+                if (!handler.getFrameSpan(data, length, '\0')) break;
+                long long arrived = nowNs();
+                FrameView frame = FrameView::parse(data, length);
+                if (frame.command.equals("MESSAGE")) {
+                    const char *at = std::search(frame.body.begin(), frame.body.end(), marker.begin(), marker.end());
+                    if (at != frame.body.end()) {
+                        long long sent = std::strtoll(at + marker.size(), nullptr, 10);
+                        latencies.record(static_cast<unsigned long long>(std::max(0LL, arrived - sent)) / 1000);
+                    }
+                    lastReceiveNs = arrived;
+                    received++;
+                    protocol.processServerFrame(frame);
+                } else if (frame.command.equals("CONNECTED")) {
+                    connected = true;
+                } else if (frame.command.equals("RECEIPT")) {
+                    // The join receipts, then the logout receipt
+                    if (++receipts > config.channels) break;
+                } else if (frame.command.equals("ERROR")) {
+                    TextSpan message;
+                    frame.header(StompHeaders::MESSAGE, message);
+                    std::cerr << "session " << number << ": server error " << message.str() << std::endl;
+                    failed = true;
+                    break;
+                }
+            }
+            done = true;
+        }
+
+        bool send(const std::string &frame)
+        {
+            if (handler.sendFrameAscii(frame, '\0')) return true;
+            failed = true;
+            return false;
+        }
+
+        // Waits until ready() or done; returns false on a timeout or if the session ended
+        bool waitFor(const std::function<bool()> &ready, double seconds)
+        {
+            Clock::time_point deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+            while (!ready()) {
+                if (done || Clock::now() > deadline) return false;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            return true;
+        }
+
+    public:
+        LatencyHistogram latencies;
+        std::atomic<bool> connected;
+        std::atomic<bool> failed;
+        std::atomic<bool> done;
+        std::atomic<int> receipts;
+        std::atomic<unsigned long long> received;
+        std::atomic<long long> lastReceiveNs;
+        unsigned long long published;
+        long long firstPublishNs;
+
+        LoadSession(const LoadConfig &config, int number) :
+            config(config), number(number), user("load" + std::to_string(number)), handler(config.host, static_cast<short>(config.port)),
+            state(), options(), protocol(state, options), receiver(), latencies(), connected(false), failed(false),
+            done(false), receipts(0), received(0), lastReceiveNs(0), published(0), firstPublishNs(0)
+        {
+            options.quiet = true;
+        }
+        LoadSession(const LoadSession &) = delete;
+        LoadSession &operator=(const LoadSession &) = delete;
+
+        ~LoadSession()
+        {
+            handler.shutdown();
+            if (receiver.joinable()) receiver.join();
+        }
+
+        // Logs in and subscribes to every channel, waiting for the receipts
+        bool open()
+        {
+            if (!handler.connect()) return false;
+            receiver = std::thread(&LoadSession::receive, this);
+            std::string hostPort = config.host + ":" + std::to_string(config.port);
+            protocol.processInput("login " + hostPort + " " + user + " load", [this](const std::string &frame) {
+                return send(frame);
+            });
+            if (!send("CONNECT\naccept-version:1.2\nhost:stomp.cs.bgu.ac.il\nlogin:" + user + "\npasscode:load\n\n")) return false;
+            if (!waitFor([this]() { return connected.load(); }, 5)) return false;
+            for (int channel = 0; channel < config.channels; channel++) {
+                protocol.processInput("join load_" + std::to_string(channel), [this](const std::string &frame) {
+                    return send(frame);
+                });
+            }
+            return waitFor([this]() { return receipts >= config.channels; }, 5);
+        }
+
+        // Publishes to the channels in turn at the configured rate until the deadline
+        void publish(Clock::time_point start, Clock::time_point deadline)
+        {
+            ReportFrameBuilder builder(user);
+            std::string description(config.payload, 'x');
+            auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / config.rate));
+            // The sessions start spread over one period instead of all at once
+            Clock::time_point next = start + period * number / config.sessions;
+            while (next < deadline && !failed) {
+                std::this_thread::sleep_until(next);
+                next += period;
+                int channel = static_cast<int>(published % config.channels);
+                EventUpdates updates;
+                long long sent = nowNs();
+                updates.set(LATENCY_KEY, std::to_string(sent));
+                Event event("load", std::to_string(channel), "load event", static_cast<int>(published), std::move(updates),
+                            EventUpdates(), EventUpdates(), description);
+                if (!send(builder.build(event))) break;
+                if (firstPublishNs == 0) firstPublishNs = sent;
+                published++;
+            }
+        }
+
+        // Waits for the logout receipt
+        void close()
+        {
+            protocol.processInput("logout", [this](const std::string &frame) {
+                return send(frame);
+            });
+            waitFor([this]() { return done.load(); }, 5);
+            handler.shutdown();
+            if (receiver.joinable()) receiver.join();
+        }
+};
+
+static bool parseArgs(int argc, char *argv[], LoadConfig &config)
+{
+    bool known = parseOptions(argc, argv, [&config](const std::string &option, const std::string &value) {
+        if (option == "--host") config.host = value;
+        else if (option == "--port") config.port = static_cast<unsigned short>(std::atoi(value.c_str()));
+        else if (option == "--sessions") config.sessions = std::atoi(value.c_str());
+        else if (option == "--channels") config.channels = std::atoi(value.c_str());
+        else if (option == "--rate") config.rate = std::atof(value.c_str());
+        else if (option == "--duration") config.duration = std::atof(value.c_str());
+        else if (option == "--payload") config.payload = static_cast<size_t>(std::atol(value.c_str()));
+        else if (option == "--record") config.record = value;
+        else return false;
+        return true;
+    });
+    // Only the built-in broker can record
+    return known && (config.port == 0 || config.record.empty()) && config.sessions > 0 && config.channels > 0 && config.rate > 0 && config.duration > 0;
+}
+
+int main(int argc, char *argv[])
+{
+    LoadConfig config;
+    if (!parseArgs(argc, argv, config)) {
+        std::cerr << "Usage: StompLoad [--host H --port P | --record F] [--sessions N] [--channels M] [--rate R] [--duration S] [--payload B]"
+                  << std::endl;
+        return 1;
+    }
+
+    FILE *result = openResultStream();
+    MockBroker broker;
+    bool mock = config.port == 0;
+    if (mock) {
+        if (!broker.start()) {
+            std::cerr << "Could not start the mock broker" << std::endl;
+            return 1;
+        }
+        if (!config.record.empty() && !broker.record(config.record)) {
+            std::cerr << "Could not create " << config.record << std::endl;
+            return 1;
+        }
+        config.port = broker.getPort();
+    }
+
+    std::vector<std::unique_ptr<LoadSession>> sessions;
+    for (int i = 0; i < config.sessions; i++) {
+        sessions.emplace_back(new LoadSession(config, i));
+        if (!sessions.back()->open()) {
+            std::cerr << "session " << i << " could not log in and subscribe" << std::endl;
+            return 1;
+        }
+    }
+
+    // Publish
+    Clock::time_point start = Clock::now() + std::chrono::milliseconds(10);
+    Clock::time_point deadline = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(config.duration));
+    std::vector<std::thread> publishers;
+    for (auto &session : sessions) {
+        LoadSession *s = session.get();
+        publishers.emplace_back([s, start, deadline]() { s->publish(start, deadline); });
+    }
+    for (std::thread &publisher : publishers) publisher.join();
+
+    // Every event goes to every session (they all subscribe to all the channels); wait for the stragglers
+    unsigned long long published = 0;
+    for (auto &session : sessions) published += session->published;
+    unsigned long long expected = published * config.sessions;
+    auto receivedSoFar = [&sessions]() {
+        unsigned long long received = 0;
+        for (auto &session : sessions) received += session->received;
+        return received;
+    };
+    Clock::time_point drainDeadline = Clock::now() + std::chrono::seconds(5);
+    while (receivedSoFar() < expected && Clock::now() < drainDeadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    LatencyHistogram latencies;
+    long long firstPublish = 0;
+    long long lastReceive = 0;
+    for (auto &session : sessions) {
+        session->close();
+        latencies.merge(session->latencies);
+        if (session->firstPublishNs != 0 && (firstPublish == 0 || session->firstPublishNs < firstPublish))
+            firstPublish = session->firstPublishNs;
+        lastReceive = std::max(lastReceive, session->lastReceiveNs.load());
+    }
+    unsigned long long received = receivedSoFar();
+    double seconds = lastReceive > firstPublish ? (lastReceive - firstPublish) / 1e9 : 0;
+
+    std::ostringstream line;
+    line << "load sessions=" << config.sessions << " channels=" << config.channels << " rate=" << config.rate
+         << " duration_s=" << config.duration << " payload=" << config.payload
+         << " broker=" << (mock ? "mock" : config.host + ":" + std::to_string(config.port))
+         << " published=" << published << " expected=" << expected << " received=" << received
+         << " msgs/s=" << static_cast<long long>(seconds > 0 ? received / seconds : 0)
+         << " p50_us=" << latencies.percentile(0.50) << " p99_us=" << latencies.percentile(0.99)
+         << " p999_us=" << latencies.percentile(0.999) << " max_us=" << latencies.getMax();
+    writeResultLine(result, line.str());
+    broker.stop();
+    return received == expected ? 0 : 2;
+}
@@ -2,33 +2,66 @@
 #include <sstream>
 #include <iostream>
 #include "../include/event.h"
-#include <fstream>
+#include "../include/ReportFrameBuilder.h"
+#include "../include/ClientStats.h"
 #include <algorithm>
+#include <unistd.h>
 
 //Constructor
-StompProtocol::StompProtocol(bool& loggedIn) : 
+StompProtocol::StompProtocol(SessionState& session, const ClientOptions& options) : 
+    gamesMutex(),
     gameReports(),        
     userName(""),        
-    shouldContinue(loggedIn), 
+    session(session), 
+    options(options), 
     subscriptionCounter(0), 
     receiptCounter(0), 
     channelToSubId(), 
-    receiptToCommand() 
+    receiptMutex(),
+    receiptToCommand(),
+    storedReports(0),
+    reportStrings(),
+    output(STDOUT_FILENO)
 {
 
 }
 
-//Gets a command and return string in STOMP format for the server to read
-std::vector<std::string> StompProtocol::processInput(std::string line) {
+StompProtocol::~StompProtocol() {
+    ClientStats::addGauge(ClientStats::GAMES, -static_cast<int64_t>(gameReports.size()));
+    ClientStats::addGauge(ClientStats::STORED_REPORTS, -static_cast<int64_t>(storedReports));
+}
+
+StompProtocol::GameShard* StompProtocol::findGame(const std::string& gameName, bool create) {
+    std::lock_guard<std::mutex> lock(gamesMutex);
+    auto it = gameReports.find(gameName);
+    if (it != gameReports.end()) return it->second.get();
+    if (!create) return nullptr;
+    GameShard* shard = new GameShard();
+    gameReports[gameName] = std::unique_ptr<GameShard>(shard);
+    ClientStats::addGauge(ClientStats::GAMES, 1);
+    return shard;
+}
+
+bool StompProtocol::snapshotReports(const std::string& gameName, const std::string& user, ReportsSnapshot& reports) {
+    GameShard* shard = findGame(gameName, false);
+    if (shard == nullptr) return false;
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    auto it = shard->reportsByUser.find(user);
+    if (it == shard->reportsByUser.end() || it->second.empty()) return false;
+    reports = it->second.snapshot();
+    return true;
+}
+
+//Gets a command and hands the frames in STOMP format for the server to read to sink
+bool StompProtocol::processInput(std::string line, const FrameSink& sink) {
     std::stringstream ss(line);
     std::string command;
     ss >> command;
-    std::vector<std::string> frames;
 
     if (command == "login") {
         std::string hostPort, password;
         ss >> hostPort >> userName >> password; 
-        return frames;
+        return true;
     }
 
     if (command == "join") {
@@ -39,262 +72,233 @@ std::vector<std::string> StompProtocol::processInput(std::string line) {
 
         // Saves the state to remember this subscription and receipt
         channelToSubId[gameName] = subId;
-        receiptToCommand[recId] = "JOINED " + gameName;
+        {
+            std::lock_guard<std::mutex> lock(receiptMutex);
+            receiptToCommand[recId] = "JOINED " + gameName;
+        }
 
         // Build the SUBSCRIBE frame
         std::string frame = "SUBSCRIBE\ndestination:/" + gameName + 
                            "\nid:" + std::to_string(subId) + 
                            "\nreceipt:" + std::to_string(recId) + "\n\n";
-        frames.push_back(frame);
-        return frames;
+        return sink(frame);
     } 
     else if (command == "exit") {
         std::string gameName;
         ss >> gameName;
 
-        if (channelToSubId.count(gameName) == 0) return frames; // Not subscribed to this channel
+        if (channelToSubId.count(gameName) == 0) return true; // Not subscribed to this channel
 
         int subId = channelToSubId[gameName];
         int recId = receiptCounter++;
         
-        receiptToCommand[recId] = "EXITED " + gameName;
+        {
+            std::lock_guard<std::mutex> lock(receiptMutex);
+            receiptToCommand[recId] = "EXITED " + gameName;
+        }
         channelToSubId.erase(gameName); // Remove from memory
 
         // Build the UNSUBSCRIBE frame
         std::string frame = "UNSUBSCRIBE\nid:" + std::to_string(subId) + 
                            "\nreceipt:" + std::to_string(recId) + "\n\n";
-        frames.push_back(frame);
-        return frames;
+        return sink(frame);
     }
     else if (command == "report") {
         std::string filePath;
         ss >> filePath;
-        names_and_events parsedData = parseEventsFile(filePath);
-        
-        for (const auto& event : parsedData.events) {
-            std::string frame = "SEND\n";
-            frame += "destination:/" + parsedData.team_a_name + "_" + parsedData.team_b_name + "\n\n"; 
-            frame += "user: " + userName + "\n";
-            frame += "team a: " + parsedData.team_a_name + "\n";
-            frame += "team b: " + parsedData.team_b_name + "\n";
-            frame += "event name: " + event.get_name() + "\n";
-            frame += "time: " + std::to_string(event.get_time()) + "\n";
-            
-            frame += "general game updates:\n";
-            for (auto const& update : event.get_game_updates()) {
-                frame += "    " + update.first + ": " + update.second + "\n";
-            }
+        bool sent = true;
 
-            frame += "team a updates:\n";
-            for (auto const& update : event.get_team_a_updates()) {
-                frame += "    " + update.first + ": " + update.second + "\n";
-            }
-
-            frame += "team b updates:\n";
-            for (auto const& update : event.get_team_b_updates()) {
-                frame += "    " + update.first + ": " + update.second + "\n";
-            }
-
-            frame += "description:\n" + event.get_discription() + "\n";
-            
-            frames.push_back(frame);
+        bool parsed;
+        if (options.reportThreads > 1) {
+            // The frames are built in batches on several threads and sent in file order, once each batch is built
+            ParallelReportBuilder builder(userName, options.reportThreads);
+            parsed = parseEventsFile(filePath, [&builder, &sink, &sent](Event&& event) {
+                sent = builder.add(std::move(event), sink);
+                return sent;
+            }, options.eventsInput);
+            // Whatever was parsed goes out, even if the file ends in an error (like in the serial path)
+            if (sent) sent = builder.flush(sink);
+        } else {
+            // Each frame is handed to the sink as soon as its event is parsed, while the file is still being read.
+            // The builder reuses one buffer for all the frames, the sink copies what it keeps.
+            ReportFrameBuilder builder(userName);
+            parsed = parseEventsFile(filePath, [&builder, &sink, &sent](const Event& event) {
+                sent = sink(builder.build(event));
+                return sent;
+            }, options.eventsInput);
+        }
+        if (!parsed && sent) {
+            std::cout << "Failed to read events file: " << filePath << std::endl;
         }
-        return frames;
+        return sent;
     }
     
     else if (command == "summary") {
             std::string gameName, userToSummarize, fileName;
             ss >> gameName >> userToSummarize >> fileName;
 
-            if (gameReports.count(gameName) == 0 || gameReports[gameName].count(userToSummarize) == 0) {
+            // The reports are kept sorted and aggregated as they arrive, so this only writes them out.
+            // The snapshot shares the events, the socket thread can keep adding reports meanwhile.
+            ReportsSnapshot reports;
+            if (!snapshotReports(gameName, userToSummarize, reports)) {
                 std::cout << "No reports found for user " << userToSummarize << " in game " << gameName << std::endl;
-                return frames; 
-            }
-
-            std::vector<Event>& events = gameReports[gameName][userToSummarize];
-            
-            // Sort events chronologically by time
-            std::sort(events.begin(), events.end(), [](const Event& a, const Event& b) {
-                if (a.get_time() != b.get_time())
-                    return a.get_time() < b.get_time();
-                return a.get_name() < b.get_name(); // Secondary sort by name
-            });
-
-            // Use maps to aggregate stats 
-            std::map<std::string, std::string> generalStats;
-            std::map<std::string, std::string> teamAStats;
-            std::map<std::string, std::string> teamBStats;
-
-            // Iterate through all events to build the final state of the game
-            for (const auto& event : events) {
-                for (auto const& update : event.get_game_updates()) 
-                    generalStats[update.first] = update.second;
-                for (auto const& update : event.get_team_a_updates()) 
-                    teamAStats[update.first] = update.second;
-                for (auto const& update : event.get_team_b_updates()) 
-                    teamBStats[update.first] = update.second;
+                return true; 
             }
 
-            std::string output = "";
-            
-            // Header with team names
-            output += events[0].get_team_a_name() + " vs " + events[0].get_team_b_name() + "\n";
-            
-            output += "Game stats:\n";
-            
-            output += "General stats:\n";
-            for (auto const& it : generalStats) {
-                output += it.first + ": " + it.second + "\n";
-            }
-            
-            output += "Team a stats:\n";
-            for (auto const& it : teamAStats) {
-                output += it.first + ": " + it.second + "\n";
-            }
-
-            output += "Team b stats:\n";
-            for (auto const& it : teamBStats) {
-                output += it.first + ": " + it.second + "\n";
-            }
-
-            // List all game event reports
-            output += "Game event reports:\n";
-            for (const auto& event : events) {
-                output += std::to_string(event.get_time()) + " - " + event.get_name() + ":\n\n";
-                output += event.get_discription() + "\n\n"; // Fixed typo from 'discription'
+            // Written straight to the file through the writer's buffer (overwriting existing content);
+            // in atomic mode the file only appears once it is complete
+            SummaryWriter outFile(fileName, options.atomicSummary);
+            if (!outFile.open()) {
+                std::cout << "Failed to open file: " << fileName << std::endl;
+                return true;
             }
-
-            // Save to file (overwriting existing content)
-            std::ofstream outFile(fileName);
-            if (outFile.is_open()) {
-                outFile << output;
-                outFile.close();
+            reports.writeSummary(outFile);
+            if (outFile.close()) {
                 std::cout << "Summary saved to " << fileName << std::endl;
             } else {
-                std::cout << "Failed to open file: " << fileName << std::endl;
+                std::cout << "Failed to write file: " << fileName << std::endl;
             }
 
-            return frames; 
+            return true; 
+        }
+        else if (command == "stats") {
+            ClientStats::print(std::cout);
+            return true;
         }
         else if (command == "logout") {
             int recId = receiptCounter++;
-            receiptToCommand[recId] = "LOGOUT";
+            {
+                std::lock_guard<std::mutex> lock(receiptMutex);
+                receiptToCommand[recId] = "LOGOUT";
+            }
 
             // יצירת פריים הדיסקונקט
             std::string frame = "DISCONNECT\nreceipt:" + std::to_string(recId) + "\n\n";
-            frames.push_back(frame + '\0'); // מוסיפים \0 לסיום פריים
-            return frames;
+            return sink(frame + '\0'); // מוסיפים \0 לסיום פריים
         }
-        return std::vector<std::string>();
+        return true;
 }
 
 
+void StompProtocol::flushOutput() {
+    output.flush();
+}
+
+// "    key: value" lines, as a report is printed
+static void appendUpdates(std::string& text, const EventUpdates& updates) {
+    for (auto const& update : updates) {
+        text += "    ";
+        text += update.first;
+        text += ": ";
+        text += update.second;
+        text += '\n';
+    }
+}
+
 //Analyze what the server sends and prints relevant information to the client
 void StompProtocol::processServerFrame(std::string frame) {
-    std::stringstream ss(frame);
-    std::string header;
-    std::getline(ss, header); // The first line is the command (CONNECTED, MESSAGE, RECEIPT, ERROR)
+    processServerFrame(FrameView::parse(frame.data(), frame.size()));
+}
 
-    if (header == "CONNECTED") {
-        std::cout << "Login successful" << std::endl; // Required message
+void StompProtocol::processServerFrame(const FrameView& frame) {
+    ClientStats::Timer timer(ClientStats::SERVER_FRAME_NS);
+    const TextSpan& header = frame.command; // The first line is the command (CONNECTED, MESSAGE, RECEIPT, ERROR)
+
+    if (header.equals("CONNECTED")) {
+        ClientStats::add(ClientStats::FRAMES_IN_CONNECTED);
+        output.write("Login successful\n"); // Required message
     } 
-    else if (header == "RECEIPT") {
-        std::string line;
-        while (std::getline(ss, line) && line.find("receipt-id:") == std::string::npos);
+    else if (header.equals("RECEIPT")) {
+        ClientStats::add(ClientStats::FRAMES_IN_RECEIPT);
+        TextSpan receiptId;
+        if (!frame.header(StompHeaders::RECEIPT_ID, receiptId)) return;
         
         // Extract the ID and search it in our map
-        int recId = std::stoi(line.substr(line.find(":") + 1));
+        int recId = std::stoi(receiptId.str());
         
-        if (receiptToCommand.count(recId)) {
-            std::string action = receiptToCommand[recId];
+        std::string action;
+        {
+            std::lock_guard<std::mutex> lock(receiptMutex);
+            auto it = receiptToCommand.find(recId);
+            if (it != receiptToCommand.end()) action = it->second;
+        }
+        if (!action.empty()) {
             if (action.find("JOINED") != std::string::npos) {
-                std::cout << "Joined channel " << action.substr(7) << std::endl;
+                output.write("Joined channel " + action.substr(7) + "\n");
             } else if (action.find("EXITED") != std::string::npos) {
-                std::cout << "Exited channel " << action.substr(7) << std::endl;
+                output.write("Exited channel " + action.substr(7) + "\n");
             } else if (action == "LOGOUT") {
-                std::cout << "Logout successful. Disconnecting..." << std::endl;
+                output.write("Logout successful. Disconnecting...\n");
                 //connectionHandler.close(); 
                 //isLoggedIn = false;
-                shouldContinue = false;
+                session.stop();
             }
         }
     }
-    else if (header == "ERROR") {
+    else if (header.equals("ERROR")) {
+        ClientStats::add(ClientStats::FRAMES_IN_ERROR);
         // Extract error type
-        std::string line;
-        std::string errorMessage = "Unknown error";
-        while (std::getline(ss, line) && line != "") {
-            if (line.find("message:") != std::string::npos) {
-                errorMessage = line.substr(8);
-            }
-        }
+        TextSpan message;
+        std::string errorMessage = frame.header(StompHeaders::MESSAGE, message) ? message.str() : "Unknown error";
         
-        std::cout << "Server Error: " << errorMessage << std::endl; //Print error
-        shouldContinue = false; //Stop loop
+        output.write("Server Error: " + errorMessage + "\n"); //Print error
+        session.stop(); //Stop loop
     }
 
-    else if (header == "MESSAGE") {
-        std::map<std::string, std::string> headers; 
-        std::string line;
-        std::string body = "";
-        while (std::getline(ss, line) && line != "" && line != "\r") {
-            if (!line.empty() && line.back() == '\r') line.pop_back();
-            size_t colonPos = line.find(':');
-            if (colonPos != std::string::npos) {
-                std::string key = line.substr(0, colonPos);
-                std::string value = line.substr(colonPos + 1);
-                key.erase(0, key.find_first_not_of(" \t\r\n"));
-                key.erase(key.find_last_not_of(" \t\r\n") + 1);
-                value.erase(0, value.find_first_not_of(" \t\r\n"));
-                value.erase(value.find_last_not_of(" \t\r\n") + 1);
-                
-                headers[key] = value;
-            }
-        }
-        while (std::getline(ss, line)) {
-            body += line + "\n";
-        }
-        std::string reportingUser = headers.count("user") ? headers["user"] : "Unknown";
+    else if (header.equals("MESSAGE")) {
+        ClientStats::add(ClientStats::FRAMES_IN_MESSAGE);
+        const TextSpan& body = frame.body;
+        TextSpan user;
+        std::string reportingUser = frame.header(StompHeaders::USER, user) ? user.str() : "Unknown";
         if (reportingUser == "Unknown") {
-            size_t userPos = body.find("user:");
-            if (userPos != std::string::npos) {
-                size_t start = userPos + 5;
-                size_t end = body.find("\n", start);
-                reportingUser = body.substr(start, end - start);
-                reportingUser.erase(0, reportingUser.find_first_not_of(" \t\r\n"));
-                reportingUser.erase(reportingUser.find_last_not_of(" \t\r\n") + 1);
+            static const char userKey[] = "user:";
+            const char* userPos = std::search(body.begin(), body.end(), userKey, userKey + 5);
+            if (userPos != body.end()) {
+                const char* start = userPos + 5;
+                const char* end = std::find(start, body.end(), '\n');
+                reportingUser = TextSpan(start, end - start).trimmed().str();
             }
         }
 
-        std::string gameName = headers.count("destination") ? headers["destination"] : "Unknown";
+        TextSpan destination;
+        std::string gameName = frame.header(StompHeaders::DESTINATION, destination) ? destination.str() : "Unknown";
         if (!gameName.empty() && gameName[0] == '/') gameName = gameName.substr(1);
 
-        Event newEvent(body); 
-        gameReports[gameName][reportingUser].push_back(newEvent);
+        Event newEvent(body.data, body.size, &reportStrings);
 
-        std::cout << "-----------------------------------" << std::endl;
-        std::cout << "user: " << reportingUser << std::endl;
-        std::cout << "team a: " << newEvent.get_team_a_name() << std::endl;
-        std::cout << "team b: " << newEvent.get_team_b_name() << std::endl;
-        std::cout << "event name: " << newEvent.get_name() << std::endl;
-        std::cout << "time: " << newEvent.get_time() << std::endl;
-        
-        std::cout << "general game updates:" << std::endl;
-        for (auto const& update : newEvent.get_game_updates()) {
-            std::cout << "    " << update.first << ": " << update.second << std::endl;
-        }
-        
-        std::cout << "team a updates:" << std::endl;
-        for (auto const& update : newEvent.get_team_a_updates()) {
-            std::cout << "    " << update.first << ": " << update.second << std::endl;
-        }
-        
-        std::cout << "team b updates:" << std::endl;
-        for (auto const& update : newEvent.get_team_b_updates()) {
-            std::cout << "    " << update.first << ": " << update.second << std::endl;
+        // The whole report is handed to the console writer at once, the socket thread doesn't wait for stdout
+        if (!options.quiet) {
+            std::string text;
+            text += "-----------------------------------\nuser: ";
+            text += reportingUser;
+            text += "\nteam a: ";
+            text += newEvent.get_team_a_name();
+            text += "\nteam b: ";
+            text += newEvent.get_team_b_name();
+            text += "\nevent name: ";
+            text += newEvent.get_name();
+            text += "\ntime: ";
+            text += std::to_string(newEvent.get_time());
+            text += "\ngeneral game updates:\n";
+            appendUpdates(text, newEvent.get_game_updates());
+            text += "team a updates:\n";
+            appendUpdates(text, newEvent.get_team_a_updates());
+            text += "team b updates:\n";
+            appendUpdates(text, newEvent.get_team_b_updates());
+            text += "description:\n";
+            text += newEvent.get_discription();
+            text += "\n-----------------------------------\n";
+            output.write(std::move(text));
         }
-        
-        std::cout << "description:" << std::endl << newEvent.get_discription() << std::endl;
-        std::cout << "-----------------------------------" << std::endl;
+
+        // Only the game's own lock is held while the event is stored
+        GameShard* shard = findGame(gameName, true);
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->reportsByUser[reportingUser].add(std::move(newEvent));
+        storedReports++;
+        ClientStats::addGauge(ClientStats::STORED_REPORTS, 1);
+    }
+    else {
+        ClientStats::add(ClientStats::FRAMES_IN_OTHER);
     }
 }
\ No newline at end of file
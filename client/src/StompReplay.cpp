@@ -0,0 +1,201 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <cstdlib>
+#include "../include/ConnectionHandler.h"
+#include "../include/StompProtocol.h"
+#include "../include/StompFrame.h"
+#include "../include/ReportFrameBuilder.h"
+#include "../include/SessionState.h"
+#include "../include/ClientOptions.h"
+#include "../include/MockBroker.h"
+#include "../include/ToolSupport.h"
+#include "../include/event.h"
+
+// Replays a recorded stream of MESSAGE frames from an in-process MockBroker to one client session
+// (ConnectionHandler, getFrameSpan and StompProtocol::processServerFrame in quiet mode, like the socket thread),
+// so the receive path can be measured without the Java server and without the noise of live publishers.
+// Usage: StompReplay (--frames F | --events E [--scale N] [--record F]) [--rate R] [--repeat K]
+//   --frames F  replays a recording, e.g. one made by StompLoad --record
+//   --events E  replays the MESSAGE frames a subscriber gets for "report E" (E's events repeated N times),
+//               and with --record also saves them as a recording
+//   --rate R    frames per second; 0 (the default) sends the recording as fast as the socket takes it
+//   --repeat K  replays K times, one session each, and keeps the fastest
+// The result is one line of key=value pairs. busy_ns/frame is the time the receiving thread spent on a
+// frame, which is what matters at a fixed rate; frames/s and MB/s are over the whole replay.
+
+static const char *USER = "replay";
+
+struct ReplayConfig
+{
+    std::string frames;
+    std::string events;
+    std::string record;
+    int scale;
+    double rate;
+    int repeat;
+
+    ReplayConfig() : frames(), events(), record(), scale(1), rate(0), repeat(3) {}
+};
+
+// What one replay went through
+struct ReplayResult
+{
+    unsigned long long frames;
+    double seconds;
+    double busySeconds;
+};
+
+// Writes the MESSAGE frames a subscriber to the game receives for "report <path>", with the headers MockBroker
+// gives them. Returns false if the recording can't be written.
+static bool recordEvents(const std::string &path, int scale, const std::string &recording)
+{
+    std::ofstream out(recording, std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+    ReportFrameBuilder builder(USER);
+    unsigned long long messageId = 0;
+    for (int i = 0; i < scale; i++) {
+        parseEventsFile(path, [&out, &builder, &messageId](const Event &event) {
+            const std::string &frame = builder.build(event);
+            size_t body = frame.find("\n\n") + 2;
+            out << "MESSAGE\nsubscription:0\ndestination:/" << event.get_team_a_name() << "_" << event.get_team_b_name()
+                << "\nmessage-id:" << messageId++ << "\nuser:" << USER << "\n\n";
+            out.write(frame.data() + body, frame.size() - body);
+            out.put('\0');
+            return true;
+        });
+    }
+    return static_cast<bool>(out);
+}
+
+// The game of the first frame of a recording (its destination without the slash), which the client joins
+static std::string firstDestination(const std::string &recording)
+{
+    std::ifstream in(recording, std::ios::binary);
+    std::string frame;
+    std::getline(in, frame, '\0');
+    FrameView view = FrameView::parse(frame.data(), frame.size());
+    TextSpan destination;
+    if (!view.header(StompHeaders::DESTINATION, destination) || destination.empty()) return "replay";
+    std::string game = destination.str();
+    return game[0] == '/' ? game.substr(1) : game;
+}
+
+// One session: logs in, joins the game, and receives until it got every frame of the recording
+static bool replayOnce(unsigned short port, const std::string &game, unsigned long long frames, ReplayResult &result)
+{
+    ConnectionHandler handler("127.0.0.1", static_cast<short>(port));
+    if (!handler.connect()) return false;
+    SessionState state;
+    ClientOptions options;
+    options.quiet = true;
+    StompProtocol protocol(state, options);
+    auto send = [&handler](const std::string &frame) { return handler.sendFrameAscii(frame, '\0'); };
+
+    std::string hostPort = "127.0.0.1:" + std::to_string(port);
+    protocol.processInput("login " + hostPort + " " + USER + " replay", send);
+    if (!send(std::string("CONNECT\naccept-version:1.2\nhost:stomp.cs.bgu.ac.il\nlogin:") + USER + "\npasscode:replay\n\n"))
+        return false;
+    protocol.processInput("join " + game, send);
+
+    result = ReplayResult{0, 0, 0};
+    Clock::time_point first;
+    Clock::duration busy(0);
+    while (result.frames < frames) {
+        const char *data;
+        size_t length;
+        if (!handler.getFrameSpan(data, length, '\0')) return false;
+        Clock::time_point arrived = Clock::now();
+        FrameView frame = FrameView::parse(data, length);
+        protocol.processServerFrame(frame);
+        if (!frame.command.equals("MESSAGE")) continue;
+        if (result.frames++ == 0) first = arrived;
+        Clock::time_point processed = Clock::now();
+        busy += processed - arrived;
+        result.seconds = std::chrono::duration<double>(processed - first).count();
+    }
+    result.busySeconds = std::chrono::duration<double>(busy).count();
+
+    protocol.processInput("logout", send);
+    handler.close();
+    return true;
+}
+
+static bool parseArgs(int argc, char *argv[], ReplayConfig &config)
+{
+    bool known = parseOptions(argc, argv, [&config](const std::string &option, const std::string &value) {
+        if (option == "--frames") config.frames = value;
+        else if (option == "--events") config.events = value;
+        else if (option == "--record") config.record = value;
+        else if (option == "--scale") config.scale = std::atoi(value.c_str());
+        else if (option == "--rate") config.rate = std::atof(value.c_str());
+        else if (option == "--repeat") config.repeat = std::atoi(value.c_str());
+        else return false;
+        return true;
+    });
+    return known && config.frames.empty() != config.events.empty() && config.scale > 0 && config.rate >= 0 &&
+           config.repeat > 0;
+}
+
+int main(int argc, char *argv[])
+{
+    ReplayConfig config;
+    if (!parseArgs(argc, argv, config)) {
+        std::cerr << "Usage: StompReplay (--frames F | --events E [--scale N] [--record F]) [--rate R] [--repeat K]"
+                  << std::endl;
+        return 1;
+    }
+
+    std::string recording = config.frames;
+    if (!config.events.empty()) {
+        recording = config.record.empty() ? "bin/replay.frames" : config.record;
+        if (!recordEvents(config.events, config.scale, recording)) {
+            std::cerr << "Could not write " << recording << std::endl;
+            return 1;
+        }
+    }
+
+    FILE *resultFile = openResultStream();
+    MockBroker broker;
+    if (!broker.loadReplay(recording, config.rate)) {
+        std::cerr << "Could not read " << recording << std::endl;
+        return 1;
+    }
+    if (broker.getReplayFrames() == 0) {
+        std::cerr << recording << " has no frames" << std::endl;
+        return 1;
+    }
+    if (!broker.start()) {
+        std::cerr << "Could not start the mock broker" << std::endl;
+        return 1;
+    }
+    std::ifstream size(recording, std::ios::binary | std::ios::ate);
+    long long bytes = static_cast<long long>(size.tellg());
+    std::string game = firstDestination(recording);
+
+    ReplayResult best{0, 0, 0};
+    for (int i = 0; i < config.repeat; i++) {
+        ReplayResult result;
+        if (!replayOnce(broker.getPort(), game, broker.getReplayFrames(), result)) {
+            std::cerr << "The replay session failed" << std::endl;
+            return 2;
+        }
+        if (i == 0 || result.seconds < best.seconds) best = result;
+    }
+    broker.stop();
+
+    double frames = static_cast<double>(best.frames);
+    std::ostringstream line;
+    line << "replay frames=" << best.frames << " bytes=" << bytes << " rate=" << config.rate
+         << " seconds=" << best.seconds
+         << " frames/s=" << static_cast<long long>(best.seconds > 0 ? frames / best.seconds : 0)
+         << " MB/s=" << (best.seconds > 0 ? bytes / best.seconds / 1e6 : 0)
+         << " busy_ns/frame=" << static_cast<long long>(best.busySeconds * 1e9 / frames);
+    writeResultLine(resultFile, line.str());
+    return 0;
+}
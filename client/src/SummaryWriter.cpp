@@ -0,0 +1,104 @@
+#include "../include/SummaryWriter.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+SummaryWriter::SummaryWriter(const std::string &path, bool atomic) :
+    path(path),
+    atomic(atomic),
+    writePath(atomic ? path + ".tmp." + std::to_string(::getpid()) : path),
+    fd(-1),
+    buffer(),
+    used(0),
+    failed(false)
+{
+}
+
+SummaryWriter::~SummaryWriter()
+{
+    discard();
+}
+
+bool SummaryWriter::open()
+{
+    // The same permissions std::ofstream would create the file with
+    fd = ::open(writePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0) return false;
+    buffer.resize(BUFFER_SIZE);
+    return true;
+}
+
+void SummaryWriter::writeAll(const char *data, size_t length)
+{
+    while (!failed && length > 0) {
+        ssize_t written = ::write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            failed = true;
+            return;
+        }
+        data += written;
+        length -= written;
+    }
+}
+
+void SummaryWriter::flush()
+{
+    writeAll(buffer.data(), used);
+    used = 0;
+}
+
+void SummaryWriter::append(const char *data, size_t length)
+{
+    if (fd < 0 || failed) return;
+    if (used + length > buffer.size()) {
+        flush();
+        // A piece as big as the buffer (a long description) is written as is, without copying it first
+        if (length >= buffer.size()) {
+            writeAll(data, length);
+            return;
+        }
+    }
+    std::memcpy(&buffer[used], data, length);
+    used += length;
+}
+
+void SummaryWriter::append(const std::string &text)
+{
+    append(text.data(), text.size());
+}
+
+void SummaryWriter::append(char c)
+{
+    append(&c, 1);
+}
+
+void SummaryWriter::appendNumber(long long number)
+{
+    char digits[24];
+    int length = std::snprintf(digits, sizeof(digits), "%lld", number);
+    append(digits, static_cast<size_t>(length));
+}
+
+bool SummaryWriter::close()
+{
+    if (fd < 0) return false;
+    flush();
+    if (::close(fd) != 0) failed = true;
+    fd = -1;
+    if (atomic) {
+        if (!failed && std::rename(writePath.c_str(), path.c_str()) != 0) failed = true;
+        if (failed) ::unlink(writePath.c_str());
+    }
+    return !failed;
+}
+
+void SummaryWriter::discard()
+{
+    if (fd < 0) return;
+    ::close(fd);
+    fd = -1;
+    if (atomic) ::unlink(writePath.c_str());
+}
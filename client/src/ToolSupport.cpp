@@ -0,0 +1,33 @@
+#include "../include/ToolSupport.h"
+#include <iostream>
+#include <unistd.h>
+
+bool parseOptions(int argc, char *argv[], const OptionHandler &handle)
+{
+    if (argc % 2 != 1) return false;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!handle(argv[i], argv[i + 1])) return false;
+    }
+    return true;
+}
+
+FILE *openResultStream()
+{
+    std::cout.flush();
+    int fd = ::dup(STDOUT_FILENO);
+    if (fd < 0) return stdout;
+    FILE *result = ::fdopen(fd, "w");
+    if (result == nullptr) {
+        ::close(fd);
+        return stdout;
+    }
+    ::dup2(STDERR_FILENO, STDOUT_FILENO);
+    return result;
+}
+
+void writeResultLine(FILE *stream, const std::string &line)
+{
+    std::fputs(line.c_str(), stream);
+    std::fputc('\n', stream);
+    std::fflush(stream);
+}
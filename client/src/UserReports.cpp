@@ -0,0 +1,99 @@
+#include "../include/UserReports.h"
+
+ReportsSnapshot::ReportsSnapshot() : events(), generalStats(), teamAStats(), teamBStats()
+{
+}
+
+static void appendStats(SummaryWriter &out, const ReportsSnapshot::Stats &stats)
+{
+    for (auto const &it : stats) {
+        out.append(it.first);
+        out.append(": ", 2);
+        out.append(it.second);
+        out.append('\n');
+    }
+}
+
+void ReportsSnapshot::writeSummary(SummaryWriter &out) const
+{
+    if (events.empty()) return;
+    const Event &first = *events.front();
+
+    // Header with team names
+    out.append(first.get_team_a_name());
+    out.append(" vs ", 4);
+    out.append(first.get_team_b_name());
+    static const char statsTitle[] = "\nGame stats:\nGeneral stats:\n";
+    out.append(statsTitle, sizeof(statsTitle) - 1);
+    appendStats(out, generalStats);
+    static const char teamATitle[] = "Team a stats:\n";
+    out.append(teamATitle, sizeof(teamATitle) - 1);
+    appendStats(out, teamAStats);
+    static const char teamBTitle[] = "Team b stats:\n";
+    out.append(teamBTitle, sizeof(teamBTitle) - 1);
+    appendStats(out, teamBStats);
+
+    // List all game event reports
+    static const char reportsTitle[] = "Game event reports:\n";
+    out.append(reportsTitle, sizeof(reportsTitle) - 1);
+    for (auto const &event : events) {
+        out.appendNumber(event->get_time());
+        out.append(" - ", 3);
+        out.append(event->get_name());
+        out.append(":\n\n", 3);
+        out.append(event->get_discription());
+        out.append("\n\n", 2);
+    }
+}
+
+UserReports::UserReports() : events(), generalStats(), teamAStats(), teamBStats()
+{
+}
+
+void UserReports::add(Event &&event)
+{
+    // Reports with the same time and name keep their arrival order, so a later report wins a tie
+    const EventTimeline::Key &key = events.insert(std::move(event));
+    apply(generalStats, key.event->get_game_updates(), key);
+    apply(teamAStats, key.event->get_team_a_updates(), key);
+    apply(teamBStats, key.event->get_team_b_updates(), key);
+}
+
+void UserReports::apply(Stats &stats, const EventUpdates &updates, const EventTimeline::Key &from)
+{
+    for (auto const &update : updates) {
+        auto it = stats.find(update.first);
+        if (it == stats.end()) {
+            stats.emplace(update.first, Stat(&from, update.second));
+        } else if (*it->second.from < from) {
+            it->second.from = &from;
+            it->second.value = update.second;
+        }
+    }
+}
+
+bool UserReports::empty() const
+{
+    return events.empty();
+}
+
+const EventTimeline &UserReports::timeline() const
+{
+    return events;
+}
+
+void UserReports::copyStats(ReportsSnapshot::Stats &copy, const Stats &stats)
+{
+    copy.reserve(stats.size());
+    for (auto const &it : stats) copy.emplace_back(it.first, it.second.value);
+}
+
+ReportsSnapshot UserReports::snapshot() const
+{
+    ReportsSnapshot copy;
+    copy.events = events.snapshot();
+    copyStats(copy.generalStats, generalStats);
+    copyStats(copy.teamAStats, teamAStats);
+    copyStats(copy.teamBStats, teamBStats);
+    return copy;
+}
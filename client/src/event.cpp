@@ -1,19 +1,127 @@
 #include "../include/event.h"
 #include "../include/json.hpp"
+#include "../include/ClientStats.h"
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <map>
 #include <vector>
 #include <sstream>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 using json = nlohmann::json;
 
-Event::Event(std::string team_a_name, std::string team_b_name, std::string name, int time,
-             std::map<std::string, std::string> game_updates, std::map<std::string, std::string> team_a_updates,
-             std::map<std::string, std::string> team_b_updates, std::string discription)
-    : team_a_name(team_a_name), team_b_name(team_b_name), name(name),
-      time(time), game_updates(game_updates), team_a_updates(team_a_updates),
-      team_b_updates(team_b_updates), description(discription)
+InternTable::InternTable() : strings()
+{
+}
+
+InternTable::Ref InternTable::intern(const std::string &text)
+{
+    auto it = strings.find(text);
+    if (it != strings.end())
+        return it->second;
+    Ref shared = std::make_shared<const std::string>(text);
+    if (strings.size() < MAX_STRINGS)
+        strings.emplace(text, shared);
+    return shared;
+}
+
+InternTable::Ref InternTable::intern(const char *data, size_t length)
+{
+    return intern(std::string(data, length));
+}
+
+// an unshared copy of a string, for events parsed without a table
+static InternTable::Ref own(const char *data, size_t length)
+{
+    return std::make_shared<const std::string>(data, length);
+}
+
+// the string of a table, or an unshared copy without one
+static InternTable::Ref intern(InternTable *strings, const char *data, size_t length)
+{
+    return strings != nullptr ? strings->intern(data, length) : own(data, length);
+}
+
+EventUpdates::EventUpdates() : entries()
+{
+}
+
+EventUpdates::EventUpdates(const std::map<std::string, std::string> &updates) : entries()
+{
+    entries.reserve(updates.size());
+    for (auto &update : updates)
+        entries.push_back(Entry(std::make_shared<const std::string>(update.first), update.second));
+}
+
+// orders entries by the text of their keys
+static bool keyLess(const EventUpdates::Entry &entry, const std::string &key)
+{
+    return *entry.first < key;
+}
+
+void EventUpdates::set(InternTable::Ref key, std::string value)
+{
+    auto it = std::lower_bound(entries.begin(), entries.end(), *key, keyLess);
+    if (it != entries.end() && *it->first == *key)
+        it->second.swap(value);
+    else
+        entries.insert(it, Entry(std::move(key), std::move(value)));
+}
+
+void EventUpdates::set(const std::string &key, std::string value)
+{
+    set(std::make_shared<const std::string>(key), std::move(value));
+}
+
+const std::string *EventUpdates::find(const std::string &key) const
+{
+    auto it = std::lower_bound(entries.begin(), entries.end(), key, keyLess);
+    if (it != entries.end() && *it->first == key)
+        return &it->second;
+    return nullptr;
+}
+
+size_t EventUpdates::size() const
+{
+    return entries.size();
+}
+
+bool EventUpdates::empty() const
+{
+    return entries.empty();
+}
+
+EventUpdates::const_iterator EventUpdates::begin() const
+{
+    return const_iterator(entries.begin());
+}
+
+EventUpdates::const_iterator EventUpdates::end() const
+{
+    return const_iterator(entries.end());
+}
+
+Event::Event(const std::string &team_a_name, const std::string &team_b_name, std::string name, int time,
+             EventUpdates game_updates, EventUpdates team_a_updates,
+             EventUpdates team_b_updates, std::string discription)
+    : Event(std::make_shared<const std::string>(team_a_name), std::make_shared<const std::string>(team_b_name),
+            std::move(name), time, std::move(game_updates), std::move(team_a_updates), std::move(team_b_updates),
+            std::move(discription))
+{
+}
+
+Event::Event(InternTable::Ref team_a_name, InternTable::Ref team_b_name, std::string name, int time,
+             EventUpdates game_updates, EventUpdates team_a_updates,
+             EventUpdates team_b_updates, std::string discription)
+    : team_a_name(std::move(team_a_name)), team_b_name(std::move(team_b_name)), name(std::move(name)),
+      time(time), game_updates(std::move(game_updates)), team_a_updates(std::move(team_a_updates)),
+      team_b_updates(std::move(team_b_updates)), description(std::move(discription))
 {
 }
 
@@ -26,12 +134,12 @@ Event::~Event()
 
 const std::string &Event::get_team_a_name() const
 {
-    return this->team_a_name;
+    return *this->team_a_name;
 }
 
 const std::string &Event::get_team_b_name() const
 {
-    return this->team_b_name;
+    return *this->team_b_name;
 }
 
 const std::string &Event::get_name() const
@@ -44,17 +152,17 @@ int Event::get_time() const
     return this->time;
 }
 
-const std::map<std::string, std::string> &Event::get_game_updates() const
+const EventUpdates &Event::get_game_updates() const
 {
     return this->game_updates;
 }
 
-const std::map<std::string, std::string> &Event::get_team_a_updates() const
+const EventUpdates &Event::get_team_a_updates() const
 {
     return this->team_a_updates;
 }
 
-const std::map<std::string, std::string> &Event::get_team_b_updates() const
+const EventUpdates &Event::get_team_b_updates() const
 {
     return this->team_b_updates;
 }
@@ -64,85 +172,383 @@ const std::string &Event::get_discription() const
     return this->description;
 }
 
-Event::Event(const std::string &frame_body) : team_a_name(""), team_b_name(""), name(""), time(0), game_updates(), team_a_updates(), team_b_updates(), description("")
+Event::Event(const std::string &frame_body, InternTable *strings) : Event(frame_body.data(), frame_body.size(), strings)
 {
-    std::stringstream ss(frame_body);
-    std::string line;
-    std::string current_section = "";
+}
 
-    while (std::getline(ss, line)) { //In every run line contains 1 line
+// True if the line [begin, end) starts with the string literal prefix
+template <size_t N>
+static bool startsWith(const char *begin, const char *end, const char (&prefix)[N])
+{
+    return static_cast<size_t>(end - begin) >= N - 1 && std::memcmp(begin, prefix, N - 1) == 0;
+}
+
+// Parses the number at the start of [begin, end) like std::stoi, without building a string.
+// Returns false (leaving value untouched) if there are no digits or the number doesn't fit in an int
+// (where std::stoi throws out_of_range) - the body comes from the network.
+static bool parseInt(const char *begin, const char *end, int &value)
+{
+    while (begin < end && (*begin == ' ' || *begin == '\t')) begin++;
+    bool negative = begin < end && *begin == '-';
+    if (begin < end && (*begin == '-' || *begin == '+')) begin++;
+    if (begin == end || *begin < '0' || *begin > '9') return false;
+    // The magnitude of INT_MIN is one more than INT_MAX
+    const long long limit = negative ? -static_cast<long long>(INT_MIN) : INT_MAX;
+    long long result = 0;
+    for (; begin < end && *begin >= '0' && *begin <= '9'; begin++) {
+        result = result * 10 + (*begin - '0');
+        if (result > limit) return false;
+    }
+    value = static_cast<int>(negative ? -result : result);
+    return true;
+}
+
+// The part of the frame body the parser is in
+enum class BodySection { NONE, GENERAL, TEAM_A, TEAM_B, DESCRIPTION };
+
+Event::Event(const char *frame_body, size_t length, InternTable *strings) : team_a_name(intern(strings, "", 0)), team_b_name(team_a_name), name(""), time(0), game_updates(), team_a_updates(), team_b_updates(), description("")
+{
+    ClientStats::Timer timer(ClientStats::EVENT_PARSE_NS, ClientStats::EVENT_PARSES);
+    // One pass over the body: every line is classified by its first character and copied at most once,
+    // straight into the field it belongs to.
+    const char *body_end = frame_body + length;
+    const char *line = frame_body;
+    BodySection section = BodySection::NONE;
+    EventUpdates *updates = nullptr; // the updates of the current section, if it has any
+
+    while (line < body_end) { //In every run [line, end) is 1 line
+        const char *newline = static_cast<const char *>(std::memchr(line, '\n', body_end - line));
+        const char *end = newline == nullptr ? body_end : newline;
+        const char *next = newline == nullptr ? body_end : newline + 1;
         // clean unwanted char
-        if (!line.empty() && line[line.length() - 1] == '\r') line.erase(line.length() - 1);
-
-        if (line.find("team a: ") == 0) team_a_name = line.substr(8);
-        else if (line.find("team b: ") == 0) team_b_name = line.substr(8);
-        else if (line.find("event name: ") == 0) name = line.substr(12);
-        else if (line.find("time: ") == 0) time = std::stoi(line.substr(6));
-        else if (line.find("general game updates:") == 0) current_section = "general";
-        else if (line.find("team a updates:") == 0) current_section = "team_a";
-        else if (line.find("team b updates:") == 0) current_section = "team_b";
-        else if (line.find("description:") == 0) current_section = "description";
-        else if (line.find("    ") == 0) { // 4 tabs
-            size_t colonPos = line.find(":");
-            if (colonPos != std::string::npos) {
-                std::string key = line.substr(4, colonPos - 4);
-                std::string value = line.substr(colonPos + 2);
-                if (current_section == "general") game_updates[key] = value;
-                else if (current_section == "team_a") team_a_updates[key] = value;
-                else if (current_section == "team_b") team_b_updates[key] = value;
+        if (end > line && *(end - 1) == '\r') end--;
+
+        bool handled = true;
+        switch (line < end ? *line : '\0') {
+        case 't':
+            if (startsWith(line, end, "team a: ")) team_a_name = intern(strings, line + 8, end - line - 8);
+            else if (startsWith(line, end, "team b: ")) team_b_name = intern(strings, line + 8, end - line - 8);
+            else if (startsWith(line, end, "time: ")) parseInt(line + 6, end, time);
+            else if (startsWith(line, end, "team a updates:")) {
+                section = BodySection::TEAM_A;
+                updates = &team_a_updates;
+            }
+            else if (startsWith(line, end, "team b updates:")) {
+                section = BodySection::TEAM_B;
+                updates = &team_b_updates;
+            }
+            else handled = false;
+            break;
+        case 'e':
+            if (startsWith(line, end, "event name: ")) name.assign(line + 12, end);
+            else handled = false;
+            break;
+        case 'g':
+            if (startsWith(line, end, "general game updates:")) {
+                section = BodySection::GENERAL;
+                updates = &game_updates;
             }
+            else handled = false;
+            break;
+        case 'd':
+            if (startsWith(line, end, "description:")) {
+                section = BodySection::DESCRIPTION;
+                updates = nullptr;
+                description.reserve(body_end - next + 1); // the rest of the body is (at most) the description
+            }
+            else handled = false;
+            break;
+        case ' ':
+            if (startsWith(line, end, "    ")) { // 4 tabs
+                const char *colon = static_cast<const char *>(std::memchr(line, ':', end - line));
+                if (colon != nullptr && updates != nullptr) {
+                    const char *value = std::min(colon + 2, end);
+                    updates->set(intern(strings, line + 4, colon - line - 4), std::string(value, end));
+                }
+            }
+            else handled = false;
+            break;
+        default:
+            handled = false;
         }
-        else if (current_section == "description") {
-            description += line + "\n";
+
+        if (!handled && section == BodySection::DESCRIPTION) {
+            description.append(line, end);
+            description += '\n';
         }
+        line = next;
     }
 }
 
-names_and_events parseEventsFile(std::string json_path)
+// moves the updates of one section out of the json object
+static EventUpdates updatesFromJson(json &section, InternTable &strings)
 {
-    std::ifstream f(json_path);
-    json data = json::parse(f);
+    EventUpdates updates;
+    for (auto &update : section.items())
+    {
+        if (update.value().is_string())
+            updates.set(strings.intern(update.key()), std::move(update.value().get_ref<std::string &>()));
+        else
+            updates.set(strings.intern(update.key()), update.value().dump());
+    }
+    return updates;
+}
 
-    std::string team_a_name = data["team a"];
-    std::string team_b_name = data["team b"];
+// checks that an element of the "events" array has the fields eventFromJson reads, with the right types.
+// returns the problem, or nullptr if there is none
+static const char *invalidEvent(const json &event)
+{
+    if (!event.is_object())
+        return "an event is not an object";
+    auto name = event.find("event name");
+    if (name == event.end() || !name->is_string())
+        return "\"event name\" is missing or not a string";
+    auto time = event.find("time");
+    if (time == event.end() || !time->is_number_integer())
+        return "\"time\" is missing or not an integer";
+    if (time->is_number_unsigned() ? time->get<unsigned long long>() > INT_MAX
+                                   : time->get<long long>() < INT_MIN || time->get<long long>() > INT_MAX)
+        return "\"time\" is out of range";
+    auto description = event.find("description");
+    if (description == event.end() || !description->is_string())
+        return "\"description\" is missing or not a string";
+    return nullptr;
+}
 
-    // run over all the events and convert them to Event objects
-    std::vector<Event> events;
-    for (auto &event : data["events"])
+// converts one element of the "events" array to an Event, moving the strings out of it.
+// the event must have passed invalidEvent
+static Event eventFromJson(const InternTable::Ref &team_a_name, const InternTable::Ref &team_b_name, json &event,
+                           InternTable &strings)
+{
+    return Event(team_a_name, team_b_name,
+                 std::move(event["event name"].get_ref<std::string &>()),
+                 event["time"].get<int>(),
+                 updatesFromJson(event["general game updates"], strings),
+                 updatesFromJson(event["team a updates"], strings),
+                 updatesFromJson(event["team b updates"], strings),
+                 std::move(event["description"].get_ref<std::string &>()));
+}
+
+// SAX handler for the events file: the top level "team a"/"team b" strings are kept, and every
+// element of the "events" array is built as a small json object, converted and handed out on its own.
+class EventFileHandler : public nlohmann::json_sax<json>
+{
+private:
+    const EventCallback &on_event;
+    // the strings shared by the events of this file, freed when the parse ends
+    InternTable strings;
+    InternTable::Ref team_a_name;
+    InternTable::Ref team_b_name;
+    bool has_team_a;
+    bool has_team_b;
+    // events that were parsed before both team names were seen
+    std::vector<json> pending;
+
+    // nesting depth of the objects/arrays outside the event being built
+    int depth;
+    // last key at the top level of the file
+    std::string top_key;
+    bool in_events;
+
+    // the event being built, and the path to the object/array currently being filled in it
+    json current;
+    std::vector<json *> stack;
+    std::string current_key;
+
+    bool emit(json &event)
     {
-        std::string name = event["event name"];
-        int time = event["time"];
-        std::string description = event["description"];
-        std::map<std::string, std::string> game_updates;
-        std::map<std::string, std::string> team_a_updates;
-        std::map<std::string, std::string> team_b_updates;
-        for (auto &update : event["general game updates"].items())
-        {
-            if (update.value().is_string())
-                game_updates[update.key()] = update.value();
-            else
-                game_updates[update.key()] = update.value().dump();
+        const char *problem = invalidEvent(event);
+        if (problem != nullptr) {
+            std::cerr << "Invalid event in events file: " << problem << std::endl;
+            return false;
+        }
+        if (!(has_team_a && has_team_b)) {
+            pending.push_back(std::move(event));
+            return true;
         }
+        return on_event(eventFromJson(team_a_name, team_b_name, event, strings));
+    }
 
-        for (auto &update : event["team a updates"].items())
-        {
-            if (update.value().is_string())
-                team_a_updates[update.key()] = update.value();
-            else
-                team_a_updates[update.key()] = update.value().dump();
+    // team names arrived after some events: hand those out now
+    bool flushPending()
+    {
+        std::vector<json> ready;
+        ready.swap(pending);
+        for (auto &event : ready) {
+            if (!emit(event)) return false;
         }
+        return true;
+    }
 
-        for (auto &update : event["team b updates"].items())
-        {
-            if (update.value().is_string())
-                team_b_updates[update.key()] = update.value();
-            else
-                team_b_updates[update.key()] = update.value().dump();
+    // puts a value into the event being built; returns where it was stored
+    json *addValue(json &&value)
+    {
+        if (stack.empty()) {
+            current = std::move(value);
+            return &current;
         }
-        
-        events.push_back(Event(team_a_name, team_b_name, name, time, game_updates, team_a_updates, team_b_updates, description));
+        json &parent = *stack.back();
+        if (parent.is_object()) {
+            parent[current_key] = std::move(value);
+            return &parent[current_key];
+        }
+        parent.push_back(std::move(value));
+        return &parent.back();
+    }
+
+    bool scalar(json &&value)
+    {
+        if (!stack.empty()) {
+            addValue(std::move(value));
+            return true;
+        }
+        if (depth == 1 && value.is_string() && (top_key == "team a" || top_key == "team b")) {
+            if (top_key == "team a") {
+                team_a_name = strings.intern(value.get_ref<const std::string &>());
+                has_team_a = true;
+            } else {
+                team_b_name = strings.intern(value.get_ref<const std::string &>());
+                has_team_b = true;
+            }
+            if (has_team_a && has_team_b && !pending.empty()) return flushPending();
+        }
+        return true;
+    }
+
+    bool startContainer(json &&value)
+    {
+        if (!stack.empty() || (in_events && depth == 2)) {
+            stack.push_back(addValue(std::move(value)));
+            return true;
+        }
+        if (depth == 1 && top_key == "events" && value.is_array()) in_events = true;
+        depth++;
+        return true;
+    }
+
+    bool endContainer()
+    {
+        if (!stack.empty()) {
+            stack.pop_back();
+            if (stack.empty()) return emit(current);
+            return true;
+        }
+        depth--;
+        if (depth == 1) in_events = false;
+        return true;
     }
-    names_and_events events_and_names{team_a_name, team_b_name, events};
+
+public:
+    EventFileHandler(const EventCallback &on_event)
+        : on_event(on_event), strings(), team_a_name(strings.intern("")), team_b_name(team_a_name), has_team_a(false), has_team_b(false), pending(),
+          depth(0), top_key(), in_events(false), current(), stack(), current_key()
+    {
+    }
+
+    bool null() override { return scalar(json()); }
+    bool boolean(bool val) override { return scalar(json(val)); }
+    bool number_integer(number_integer_t val) override { return scalar(json(val)); }
+    bool number_unsigned(number_unsigned_t val) override { return scalar(json(val)); }
+    bool number_float(number_float_t val, const string_t &) override { return scalar(json(val)); }
+    bool string(string_t &val) override { return scalar(json(std::move(val))); }
+    bool binary(binary_t &val) override { return scalar(json(std::move(val))); }
+    bool start_object(std::size_t) override { return startContainer(json::object()); }
+    bool start_array(std::size_t) override { return startContainer(json::array()); }
+    bool end_object() override { return endContainer(); }
+    bool end_array() override { return endContainer(); }
+
+    bool key(string_t &val) override
+    {
+        if (!stack.empty()) current_key = val;
+        else if (depth == 1) top_key = val;
+        return true;
+    }
+
+    bool parse_error(std::size_t position, const std::string &, const nlohmann::detail::exception &ex) override
+    {
+        std::cerr << "Failed to parse events file at byte " << position << ": " << ex.what() << std::endl;
+        return false;
+    }
+
+    // the top level team names ("" if the file has none)
+    const std::string &teamA() const { return *team_a_name; }
+    const std::string &teamB() const { return *team_b_name; }
+
+    // events still waiting for team names when the file ended
+    bool finish()
+    {
+        has_team_a = has_team_b = true;
+        return flushPending();
+    }
+};
+
+// a file mapped read-only into memory, unmapped when it goes out of scope
+class MappedFile
+{
+private:
+    int fd;
+    void *address;
+    size_t length;
+
+public:
+    MappedFile(const std::string &path) : fd(::open(path.c_str(), O_RDONLY)), address(MAP_FAILED), length(0)
+    {
+        struct stat info;
+        if (fd < 0 || ::fstat(fd, &info) != 0 || info.st_size == 0)
+            return;
+        length = static_cast<size_t>(info.st_size);
+        address = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address != MAP_FAILED)
+            ::madvise(address, length, MADV_SEQUENTIAL); // only a hint, the parser reads the file once front to back
+    }
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile()
+    {
+        if (address != MAP_FAILED)
+            ::munmap(address, length);
+        if (fd >= 0)
+            ::close(fd);
+    }
+
+    bool isOpen() const { return address != MAP_FAILED; }
+    const char *begin() const { return static_cast<const char *>(address); }
+    const char *end() const { return begin() + length; }
+};
+
+static bool parseWith(EventFileHandler &handler, const std::string &json_path, EventFileInput input)
+{
+    if (input == EventFileInput::MMAP) {
+        MappedFile file(json_path);
+        if (!file.isOpen() || !json::sax_parse(file.begin(), file.end(), &handler))
+            return false;
+    } else {
+        std::ifstream f(json_path);
+        if (!f.is_open() || !json::sax_parse(f, &handler))
+            return false;
+    }
+    return handler.finish();
+}
+
+bool parseEventsFile(const std::string &json_path, const EventCallback &on_event, EventFileInput input)
+{
+    EventFileHandler handler(on_event);
+    return parseWith(handler, json_path, input);
+}
+
+names_and_events parseEventsFile(std::string json_path)
+{
+    // run over all the events and collect them
+    names_and_events events_and_names{"", "", std::vector<Event>()};
+    EventCallback collect = [&events_and_names](Event &&event) {
+        events_and_names.events.push_back(std::move(event));
+        return true;
+    };
+    EventFileHandler handler(collect);
+    parseWith(handler, json_path, EventFileInput::STREAM);
+    // the names come from the top of the file, so a file without events still has them
+    events_and_names.team_a_name = handler.teamA();
+    events_and_names.team_b_name = handler.teamB();
 
     return events_and_names;
-}
\ No newline at end of file
+}